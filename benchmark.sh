@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+# Runs kmslife on a vkms device with every seed pattern, scale and swap
+# mode and prints the presentation statistics of each run, then runs the
+# lease manager with one instance per output of the device. The device is
+# looked up in sysfs unless it is given as the second argument. Load the
+# vkms module first, e.g. with "modprobe vkms"; kernels with vkms configfs
+# support can create devices with several outputs to test leasing.
+#
+# usage: benchmark.sh KMSLIFE [DEVICE]
+#
+
+kmslife=${1:-./kmslife}
+device=$2
+frames=${FRAMES:-300}
+
+if test -z "$device"; then
+	for card in /sys/class/drm/card*; do
+		case `readlink -f $card/device` in
+		*/vkms)
+			device=/dev/dri/`basename $card`
+			break
+			;;
+		esac
+	done
+fi
+
+if test -z "$device"; then
+	echo "no vkms device found" >&2
+	exit 1
+fi
+
+status=0
+
+for pattern in random --acorn --die-hard --glider --gun --pentomino; do
+	for scale in 1 2 4 8; do
+		for swap in setcrtc flip atomic; do
+			test "$pattern" = random && args="--seed=1" || args=$pattern
+
+			printf "%-12s scale %u %-8s " "${pattern#--}" $scale $swap
+
+			$kmslife --benchmark=$frames --scale=$scale \
+				--swap=$swap $args $device || status=1
+		done
+	done
+done
+
+for swap in setcrtc flip atomic; do
+	echo "lease manager, $swap:"
+
+	$kmslife --lease-manager --benchmark=$frames --swap=$swap --seed=1 \
+		$device || status=1
+done
+
+exit $status
@@ -0,0 +1,645 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "census.h"
+
+#define CENSUS_CODE_MAX 1024
+
+struct census_cell {
+	int x, y;
+};
+
+struct census_pattern {
+	struct census_cell *cells;
+	unsigned int count;
+	unsigned int size;
+};
+
+static const char census_digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+static uint32_t census_hash(const char *key)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*key) {
+		hash ^= (uint8_t)*key++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static struct census_entry *census_table_slot(const struct census_table *table,
+					      const char *key)
+{
+	unsigned int mask = table->size - 1, i = census_hash(key) & mask;
+
+	while (table->entries[i].key && strcmp(table->entries[i].key, key) != 0)
+		i = (i + 1) & mask;
+
+	return &table->entries[i];
+}
+
+static int census_table_grow(struct census_table *table)
+{
+	unsigned int size = table->size ? table->size * 2 : 256, i;
+	struct census_entry *entries = table->entries, *slot;
+	unsigned int old = table->size;
+
+	table->entries = calloc(size, sizeof(*entries));
+	if (!table->entries) {
+		table->entries = entries;
+		return -ENOMEM;
+	}
+
+	table->size = size;
+
+	for (i = 0; i < old; i++) {
+		if (entries[i].key) {
+			slot = census_table_slot(table, entries[i].key);
+			*slot = entries[i];
+		}
+	}
+
+	free(entries);
+
+	return 0;
+}
+
+/* returns the entry for a key, inserting an empty one if necessary */
+static struct census_entry *census_table_get(struct census_table *table,
+					     const char *key)
+{
+	struct census_entry *entry;
+
+	if ((table->used + 1) * 2 > table->size &&
+	    census_table_grow(table) < 0)
+		return NULL;
+
+	entry = census_table_slot(table, key);
+	if (!entry->key) {
+		entry->key = strdup(key);
+		if (!entry->key)
+			return NULL;
+
+		table->used++;
+	}
+
+	return entry;
+}
+
+static void census_table_clear(struct census_table *table)
+{
+	unsigned int i;
+
+	for (i = 0; i < table->size; i++) {
+		free(table->entries[i].code);
+		free(table->entries[i].key);
+	}
+
+	free(table->entries);
+}
+
+static int census_pattern_add(struct census_pattern *pattern, int x, int y)
+{
+	if (pattern->count == pattern->size) {
+		unsigned int size = pattern->size ? pattern->size * 2 : 64;
+		struct census_cell *cells;
+
+		cells = realloc(pattern->cells, size * sizeof(*cells));
+		if (!cells)
+			return -ENOMEM;
+
+		pattern->cells = cells;
+		pattern->size = size;
+	}
+
+	pattern->cells[pattern->count].x = x;
+	pattern->cells[pattern->count].y = y;
+	pattern->count++;
+
+	return 0;
+}
+
+/* one of the eight rotations and reflections */
+static void census_transform(const struct census_cell *cell,
+			     unsigned int transform, int *x, int *y)
+{
+	int tx = cell->x, ty = cell->y;
+
+	if (transform & 4) {
+		tx = cell->y;
+		ty = cell->x;
+	}
+
+	*x = (transform & 1) ? -tx : tx;
+	*y = (transform & 2) ? -ty : ty;
+}
+
+static char *census_zeros(char *code, unsigned int zeros)
+{
+	unsigned int count;
+
+	while (zeros >= 4) {
+		count = zeros < 39 ? zeros : 39;
+		*code++ = 'y';
+		*code++ = census_digits[count - 4];
+		zeros -= count;
+	}
+
+	if (zeros == 3)
+		*code++ = 'x';
+	else if (zeros == 2)
+		*code++ = 'w';
+	else if (zeros == 1)
+		*code++ = '0';
+
+	return code;
+}
+
+/*
+ * Encodes a pattern in extended Wechsler format: rows are taken in strips
+ * of five, each column of a strip becomes one base-32 digit, strips are
+ * separated by 'z' and runs of empty columns are compressed. Returns false
+ * if the pattern is too large to be encoded.
+ */
+static bool census_wechsler(const struct census_pattern *pattern,
+			    unsigned int transform, char *code)
+{
+	uint8_t columns[(CENSUS_MAX_SIZE + 4) / 5 * CENSUS_MAX_SIZE];
+	int minx = INT_MAX, miny = INT_MAX, maxx = INT_MIN, maxy = INT_MIN;
+	unsigned int width, height, strips, zeros, i, s;
+	int x, y;
+
+	for (i = 0; i < pattern->count; i++) {
+		census_transform(&pattern->cells[i], transform, &x, &y);
+
+		if (x < minx)
+			minx = x;
+
+		if (x > maxx)
+			maxx = x;
+
+		if (y < miny)
+			miny = y;
+
+		if (y > maxy)
+			maxy = y;
+	}
+
+	width = maxx - minx + 1;
+	height = maxy - miny + 1;
+
+	if (width > CENSUS_MAX_SIZE || height > CENSUS_MAX_SIZE)
+		return false;
+
+	strips = (height + 4) / 5;
+	memset(columns, 0, strips * width);
+
+	for (i = 0; i < pattern->count; i++) {
+		census_transform(&pattern->cells[i], transform, &x, &y);
+		x -= minx;
+		y -= miny;
+
+		columns[(y / 5) * width + x] |= 1 << (y % 5);
+	}
+
+	for (s = 0; s < strips; s++) {
+		if (s > 0)
+			*code++ = 'z';
+
+		/* trailing empty columns of a strip are dropped */
+		for (i = 0, zeros = 0; i < width; i++) {
+			uint8_t column = columns[s * width + i];
+
+			if (!column) {
+				zeros++;
+				continue;
+			}
+
+			code = census_zeros(code, zeros);
+			*code++ = census_digits[column];
+			zeros = 0;
+		}
+	}
+
+	*code = '\0';
+
+	return true;
+}
+
+/* the canonical code is the shortest, then lexicographically smallest */
+static bool census_better(const char *code, const char *best)
+{
+	size_t a = strlen(code), b = strlen(best);
+
+	return !b || a < b || (a == b && strcmp(code, best) < 0);
+}
+
+static bool census_canonicalize(const struct census_pattern *pattern,
+				char *best)
+{
+	char code[CENSUS_CODE_MAX];
+	unsigned int transform;
+
+	for (transform = 0; transform < 8; transform++) {
+		if (!census_wechsler(pattern, transform, code))
+			return false;
+
+		if (census_better(code, best))
+			strcpy(best, code);
+	}
+
+	return true;
+}
+
+/*
+ * Runs an object in an otherwise empty universe until it returns to its
+ * initial phase, possibly translated. The universe has enough room around
+ * the object that it can not reach the edges within the maximum period.
+ */
+static const char *census_identify(const struct census_pattern *pattern,
+				   const char *key, char *code)
+{
+	const unsigned int margin = CENSUS_MAX_PERIOD + 1;
+	int minx = INT_MAX, miny = INT_MAX, maxx = INT_MIN, maxy = INT_MIN;
+	struct census_pattern phase = { 0 };
+	char best[CENSUS_CODE_MAX] = "";
+	char current[CENSUS_CODE_MAX];
+	unsigned int width, height, i, period = 0;
+	const char *result = "zz_UNKNOWN";
+	uint8_t *buffer, *cells, *next, *tmp;
+	int x0, y0, x1, y1, x, y;
+	bool moved = false;
+
+	for (i = 0; i < pattern->count; i++) {
+		const struct census_cell *cell = &pattern->cells[i];
+
+		if (cell->x < minx)
+			minx = cell->x;
+
+		if (cell->x > maxx)
+			maxx = cell->x;
+
+		if (cell->y < miny)
+			miny = cell->y;
+
+		if (cell->y > maxy)
+			maxy = cell->y;
+	}
+
+	width = maxx - minx + 1 + 2 * margin;
+	height = maxy - miny + 1 + 2 * margin;
+
+	buffer = calloc(2 * width, height);
+	if (!buffer)
+		return NULL;
+
+	cells = buffer;
+	next = buffer + width * height;
+
+	for (i = 0; i < pattern->count; i++) {
+		x = pattern->cells[i].x - minx + margin;
+		y = pattern->cells[i].y - miny + margin;
+		cells[y * width + x] = 1;
+	}
+
+	x0 = margin;
+	y0 = margin;
+	x1 = maxx - minx + margin;
+	y1 = maxy - miny + margin;
+
+	if (!census_canonicalize(pattern, best)) {
+		result = "zz_LARGE";
+		goto out;
+	}
+
+	while (++period <= CENSUS_MAX_PERIOD) {
+		int nx0 = INT_MAX, ny0 = INT_MAX, nx1 = INT_MIN, ny1 = INT_MIN;
+
+		phase.count = 0;
+
+		for (y = y0 - 1; y <= y1 + 1; y++) {
+			for (x = x0 - 1; x <= x1 + 1; x++) {
+				const uint8_t *c = &cells[y * width + x];
+				const ptrdiff_t w = width;
+				unsigned int n;
+
+				n = c[-w - 1] + c[-w] + c[-w + 1] + c[-1] + c[1] +
+				    c[w - 1] + c[w] + c[w + 1];
+
+				next[y * width + x] = n == 3 || (n == 2 && *c);
+
+				if (!next[y * width + x])
+					continue;
+
+				if (census_pattern_add(&phase, x, y) < 0) {
+					result = NULL;
+					goto out;
+				}
+
+				if (x < nx0)
+					nx0 = x;
+
+				if (x > nx1)
+					nx1 = x;
+
+				if (y < ny0)
+					ny0 = y;
+
+				if (y > ny1)
+					ny1 = y;
+			}
+		}
+
+		/* clear the old generation so that the buffers can be swapped */
+		for (y = y0; y <= y1; y++)
+			memset(&cells[y * width + x0], 0, x1 - x0 + 1);
+
+		tmp = cells;
+		cells = next;
+		next = tmp;
+
+		if (!phase.count)
+			goto out;
+
+		x0 = nx0;
+		y0 = ny0;
+		x1 = nx1;
+		y1 = ny1;
+
+		if (!census_wechsler(&phase, 0, current)) {
+			result = "zz_LARGE";
+			goto out;
+		}
+
+		if (strcmp(current, key) == 0) {
+			moved = x0 != (int)margin || y0 != (int)margin;
+			break;
+		}
+
+		if (!census_canonicalize(&phase, best)) {
+			result = "zz_LARGE";
+			goto out;
+		}
+	}
+
+	if (period > CENSUS_MAX_PERIOD)
+		goto out;
+
+	if (moved)
+		snprintf(code, CENSUS_CODE_MAX, "xq%u_%s", period, best);
+	else if (period > 1)
+		snprintf(code, CENSUS_CODE_MAX, "xp%u_%s", period, best);
+	else
+		snprintf(code, CENSUS_CODE_MAX, "xs%u_%s", pattern->count,
+			 best);
+
+	result = code;
+
+out:
+	free(phase.cells);
+	free(buffer);
+	return result;
+}
+
+/*
+ * Most objects in the ash are common, so the canonical code is looked up
+ * by the code of the phase and orientation in which the object was found
+ * and objects are only run in isolation the first time they are seen.
+ */
+static const char *census_classify(struct census *census,
+				   const struct census_pattern *pattern)
+{
+	char key[CENSUS_CODE_MAX], code[CENSUS_CODE_MAX];
+	struct census_entry *entry;
+	const char *result;
+
+	if (!census_wechsler(pattern, 0, key))
+		return "zz_LARGE";
+
+	entry = census_table_get(&census->cache, key);
+	if (!entry)
+		return NULL;
+
+	if (!entry->code) {
+		result = census_identify(pattern, key, code);
+		if (!result)
+			return NULL;
+
+		entry->code = strdup(result);
+	}
+
+	return entry->code;
+}
+
+int census_create(struct census **censusp)
+{
+	struct census *census;
+
+	census = calloc(1, sizeof(*census));
+	if (!census)
+		return -ENOMEM;
+
+	*censusp = census;
+
+	return 0;
+}
+
+int census_free(struct census *census)
+{
+	if (!census)
+		return -EINVAL;
+
+	census_table_clear(&census->objects);
+	census_table_clear(&census->cache);
+	free(census->visited);
+	free(census);
+
+	return 0;
+}
+
+int census_add(struct census *census, const char *code, unsigned long count)
+{
+	struct census_entry *entry;
+
+	entry = census_table_get(&census->objects, code);
+	if (!entry)
+		return -ENOMEM;
+
+	entry->count += count;
+
+	return 0;
+}
+
+int census_merge(struct census *census, const struct census *other)
+{
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < other->objects.size; i++) {
+		const struct census_entry *entry = &other->objects.entries[i];
+
+		if (!entry->key)
+			continue;
+
+		err = census_add(census, entry->key, entry->count);
+		if (err < 0)
+			return err;
+	}
+
+	return 0;
+}
+
+static unsigned int census_wrap(int value, unsigned int max)
+{
+	return ((value % (int)max) + max) % max;
+}
+
+/*
+ * Collects the live cells of the connected component of the mask that
+ * contains the given cell. Coordinates are unwrapped, so components that
+ * cross the edges of the torus are kept in one piece.
+ */
+static int census_component(struct census *census, const uint8_t *cells,
+			    const uint8_t *mask, unsigned int width,
+			    unsigned int height, struct census_cell *queue,
+			    struct census_pattern *pattern)
+{
+	size_t head, tail = 1;
+	int dx, dy, err;
+
+	census->visited[queue[0].y * width + queue[0].x] = 1;
+	pattern->count = 0;
+
+	for (head = 0; head < tail; head++) {
+		struct census_cell cell = queue[head];
+		unsigned int i;
+
+		i = census_wrap(cell.y, height) * width +
+		    census_wrap(cell.x, width);
+
+		if (cells[i]) {
+			err = census_pattern_add(pattern, cell.x, cell.y);
+			if (err < 0)
+				return err;
+		}
+
+		for (dy = -1; dy <= 1; dy++) {
+			for (dx = -1; dx <= 1; dx++) {
+				i = census_wrap(cell.y + dy, height) * width +
+				    census_wrap(cell.x + dx, width);
+
+				if (!mask[i] || census->visited[i])
+					continue;
+
+				census->visited[i] = 1;
+				queue[tail].x = cell.x + dx;
+				queue[tail].y = cell.y + dy;
+				tail++;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Separates the ash of a stabilised soup into objects and adds them to the
+ * census. The universe is a torus of the given size, the cells are one of
+ * the phases of the ash and the mask is the union of all of its phases, so
+ * that oscillators whose phases are disconnected and the paths of moving
+ * objects still form a single connected component.
+ */
+int census_ash(struct census *census, const uint8_t *cells,
+	       const uint8_t *mask, unsigned int width, unsigned int height)
+{
+	size_t size = (size_t)width * height, i;
+	struct census_pattern pattern = { 0 };
+	struct census_cell *queue;
+	const char *code;
+	int err = 0;
+
+	if (census->size < size) {
+		uint8_t *visited = realloc(census->visited, size);
+
+		if (!visited)
+			return -ENOMEM;
+
+		census->visited = visited;
+		census->size = size;
+	}
+
+	queue = malloc(size * sizeof(*queue));
+	if (!queue)
+		return -ENOMEM;
+
+	memset(census->visited, 0, size);
+
+	for (i = 0; i < size; i++) {
+		if (!mask[i] || census->visited[i])
+			continue;
+
+		queue[0].x = i % width;
+		queue[0].y = i / width;
+
+		err = census_component(census, cells, mask, width, height,
+				       queue, &pattern);
+		if (err < 0)
+			break;
+
+		if (!pattern.count)
+			continue;
+
+		code = census_classify(census, &pattern);
+		if (!code) {
+			err = -ENOMEM;
+			break;
+		}
+
+		err = census_add(census, code, 1);
+		if (err < 0)
+			break;
+	}
+
+	free(pattern.cells);
+	free(queue);
+	return err;
+}
+
+static int census_entry_compare(const void *a, const void *b)
+{
+	const struct census_entry *ea = *(const struct census_entry **)a;
+	const struct census_entry *eb = *(const struct census_entry **)b;
+
+	if (ea->count != eb->count)
+		return ea->count < eb->count ? 1 : -1;
+
+	return strcmp(ea->key, eb->key);
+}
+
+/* prints the objects, most common first */
+void census_print(const struct census *census, FILE *fp)
+{
+	const struct census_entry **entries;
+	unsigned int i, count = 0;
+
+	entries = calloc(census->objects.used, sizeof(*entries));
+	if (!entries && census->objects.used)
+		return;
+
+	for (i = 0; i < census->objects.size; i++)
+		if (census->objects.entries[i].key)
+			entries[count++] = &census->objects.entries[i];
+
+	qsort(entries, count, sizeof(*entries), census_entry_compare);
+
+	for (i = 0; i < count; i++)
+		fprintf(fp, "%s %lu\n", entries[i]->key, entries[i]->count);
+
+	free(entries);
+}
@@ -0,0 +1,42 @@
+#ifndef CENSUS_H
+#define CENSUS_H 1
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* longest period and largest extent of objects that can be classified */
+#define CENSUS_MAX_PERIOD 64
+#define CENSUS_MAX_SIZE 64
+
+struct census_entry {
+	char *key;
+	char *code;
+	unsigned long count;
+};
+
+struct census_table {
+	struct census_entry *entries;
+	unsigned int size;
+	unsigned int used;
+};
+
+struct census {
+	/* number of occurrences of each canonical code */
+	struct census_table objects;
+	/* maps the code of an object's observed phase to its canonical code */
+	struct census_table cache;
+
+	/* scratch space for separating objects */
+	uint8_t *visited;
+	size_t size;
+};
+
+int census_create(struct census **censusp);
+int census_free(struct census *census);
+int census_add(struct census *census, const char *code, unsigned long count);
+int census_merge(struct census *census, const struct census *other);
+int census_ash(struct census *census, const uint8_t *cells,
+	       const uint8_t *mask, unsigned int width, unsigned int height);
+void census_print(const struct census *census, FILE *fp);
+
+#endif /* CENSUS_H */
@@ -1,4 +1,5 @@
 #include <errno.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <sys/mman.h>
 
@@ -96,9 +97,11 @@ int dumb_bo_unmap(struct dumb_bo *bo)
 	return 0;
 }
 
-int surface_create(struct surface **surfacep, struct screen *screen,
-		   unsigned int width, unsigned int height, unsigned int bpp)
+int surface_create_with_format(struct surface **surfacep,
+			       struct screen *screen, unsigned int width,
+			       unsigned int height, uint32_t format)
 {
+	uint32_t handles[4] = { 0 }, pitches[4] = { 0 }, offsets[4] = { 0 };
 	struct surface *surface;
 	int err;
 
@@ -109,17 +112,19 @@ int surface_create(struct surface **surfacep, struct screen *screen,
 	surface->screen = screen;
 	surface->width = width;
 	surface->height = height;
-	surface->bpp = bpp;
+	surface->bpp = 32;
 
-	err = dumb_bo_create(&surface->bo, screen->fd, width, height, bpp);
+	err = dumb_bo_create(&surface->bo, screen->fd, width, height, 32);
 	if (err < 0) {
 		free(surface);
 		return err;
 	}
 
-	err = drmModeAddFB(screen->fd, width, height, 24, 32,
-			   surface->bo->pitch, surface->bo->handle,
-			   &surface->id);
+	handles[0] = surface->bo->handle;
+	pitches[0] = surface->bo->pitch;
+
+	err = drmModeAddFB2(screen->fd, width, height, format, handles,
+			    pitches, offsets, &surface->id, 0);
 	if (err < 0) {
 		dumb_bo_destroy(surface->bo);
 		free(surface);
@@ -131,6 +136,17 @@ int surface_create(struct surface **surfacep, struct screen *screen,
 	return 0;
 }
 
+/* creates a surface in the XRGB8888 format that scanout always supports */
+int surface_create(struct surface **surfacep, struct screen *screen,
+		   unsigned int width, unsigned int height, unsigned int bpp)
+{
+	if (bpp != 32)
+		return -EINVAL;
+
+	return surface_create_with_format(surfacep, screen, width, height,
+					  DRM_FORMAT_XRGB8888);
+}
+
 int surface_destroy(struct surface *surface)
 {
 	if (!surface)
@@ -172,9 +188,82 @@ int surface_unlock(struct surface *surface)
 	return 0;
 }
 
+/*
+ * Looks up a property of a KMS object by name. Returns the ID of the
+ * property, or 0 if the object has none of that name.
+ */
+uint32_t object_get_property(int fd, uint32_t id, uint32_t type,
+			     const char *name, uint64_t *value)
+{
+	drmModeObjectProperties *props;
+	drmModePropertyRes *prop;
+	uint32_t i, ret = 0;
+
+	props = drmModeObjectGetProperties(fd, id, type);
+	if (!props)
+		return 0;
+
+	for (i = 0; i < props->count_props && !ret; i++) {
+		prop = drmModeGetProperty(fd, props->props[i]);
+		if (!prop)
+			continue;
+
+		if (strcmp(prop->name, name) == 0) {
+			if (value)
+				*value = props->prop_values[i];
+
+			ret = prop->prop_id;
+		}
+
+		drmModeFreeProperty(prop);
+	}
+
+	drmModeFreeObjectProperties(props);
+	return ret;
+}
+
+/*
+ * Returns the index of a CRTC that can drive the connector and whose bit is
+ * not set in busy, preferring the one that drives it already.
+ */
+int connector_find_crtc(int fd, drmModeRes *res, drmModeConnector *connector,
+			uint32_t busy)
+{
+	drmModeEncoder *encoder;
+	int i, j, pipe = -ENODEV;
+
+	encoder = drmModeGetEncoder(fd, connector->encoder_id);
+	if (encoder) {
+		for (i = 0; i < res->count_crtcs; i++)
+			if (res->crtcs[i] == encoder->crtc_id &&
+			    !(busy & (1u << i)))
+				pipe = i;
+
+		drmModeFreeEncoder(encoder);
+	}
+
+	for (i = 0; i < connector->count_encoders && pipe < 0; i++) {
+		encoder = drmModeGetEncoder(fd, connector->encoders[i]);
+		if (!encoder)
+			continue;
+
+		for (j = 0; j < res->count_crtcs; j++) {
+			if ((encoder->possible_crtcs & (1u << j)) &&
+			    !(busy & (1u << j))) {
+				pipe = j;
+				break;
+			}
+		}
+
+		drmModeFreeEncoder(encoder);
+	}
+
+	return pipe;
+}
+
 static int screen_choose_output(struct screen *screen)
 {
-	int ret = -ENODEV;
+	int pipe, ret = -ENODEV;
 	drmModeRes *res;
 	uint32_t i;
 
@@ -187,51 +276,100 @@ static int screen_choose_output(struct screen *screen)
 
 	for (i = 0; i < res->count_connectors; i++) {
 		drmModeConnector *connector;
-		drmModeEncoder *encoder;
 
 		connector = drmModeGetConnector(screen->fd, res->connectors[i]);
 		if (!connector)
 			continue;
 
-		if (connector->connection != DRM_MODE_CONNECTED) {
+		if (connector->connection != DRM_MODE_CONNECTED ||
+		    !connector->count_modes) {
 			drmModeFreeConnector(connector);
 			continue;
 		}
 
-		encoder = drmModeGetEncoder(screen->fd, connector->encoder_id);
-		if (!encoder) {
+		/*
+		 * Outputs that are switched off, as well as those of a
+		 * lease that was just created, have no CRTC assigned yet.
+		 */
+		pipe = connector_find_crtc(screen->fd, res, connector, 0);
+		if (pipe < 0) {
 			drmModeFreeConnector(connector);
 			continue;
 		}
 
 		screen->connector = res->connectors[i];
 		screen->mode = connector->modes[0];
-		screen->crtc = encoder->crtc_id;
+		screen->crtc = res->crtcs[pipe];
+		screen->pipe = pipe;
 
-		drmModeFreeEncoder(encoder);
 		drmModeFreeConnector(connector);
 		ret = 0;
 		break;
 	}
 
-	for (i = 0; i < res->count_crtcs; i++) {
-		drmModeCrtc *crtc;
+	drmModeFreeResources(res);
+	return ret;
+}
 
-		crtc = drmModeGetCrtc(screen->fd, res->crtcs[i]);
-		if (!crtc)
-			continue;
+/* compares the timings of two modes, ignoring their names and types */
+static bool mode_equal(const drmModeModeInfo *a, const drmModeModeInfo *b)
+{
+	return a->clock == b->clock && a->hdisplay == b->hdisplay &&
+	       a->hsync_start == b->hsync_start &&
+	       a->hsync_end == b->hsync_end && a->htotal == b->htotal &&
+	       a->hskew == b->hskew && a->vdisplay == b->vdisplay &&
+	       a->vsync_start == b->vsync_start &&
+	       a->vsync_end == b->vsync_end && a->vtotal == b->vtotal &&
+	       a->vscan == b->vscan && a->flags == b->flags;
+}
 
-		if (crtc->crtc_id == screen->crtc) {
-			drmModeFreeCrtc(crtc);
-			screen->pipe = i;
-			break;
-		}
+static int screen_commit(struct screen *screen, uint32_t fb)
+{
+	drmModeAtomicReq *req;
+	int err;
 
-		drmModeFreeCrtc(crtc);
+	req = drmModeAtomicAlloc();
+	if (!req)
+		return -ENOMEM;
+
+	err = drmModeAtomicAddProperty(req, screen->plane, screen->fb_id, fb);
+	if (err >= 0) {
+		err = drmModeAtomicCommit(screen->fd, req,
+					  DRM_MODE_ATOMIC_NONBLOCK |
+					  DRM_MODE_PAGE_FLIP_EVENT, screen);
+		if (err < 0)
+			err = -errno;
 	}
 
-	drmModeFreeResources(res);
-	return ret;
+	drmModeAtomicFree(req);
+
+	if (err < 0)
+		return err;
+
+	screen->pending = true;
+
+	return 0;
+}
+
+/*
+ * Queues a framebuffer for scanout without a modeset, as an atomic commit
+ * without ALLOW_MODESET in atomic mode and as a page flip otherwise.
+ */
+static int screen_show(struct screen *screen, uint32_t fb)
+{
+	int err;
+
+	if (screen->swap_mode == SCREEN_SWAP_ATOMIC)
+		return screen_commit(screen, fb);
+
+	err = drmModePageFlip(screen->fd, screen->crtc, fb,
+			      DRM_MODE_PAGE_FLIP_EVENT, screen);
+	if (err < 0)
+		return -errno;
+
+	screen->pending = true;
+
+	return 0;
 }
 
 int screen_create(struct screen **screenp, int fd, unsigned int width,
@@ -241,8 +379,13 @@ int screen_create(struct screen **screenp, int fd, unsigned int width,
 	unsigned int i;
 	int err;
 
+	/*
+	 * The holder of a lease is master of the leased objects for as long
+	 * as its lessor is master, but can never become master of the whole
+	 * device, which is reported as -EINVAL.
+	 */
 	err = drmSetMaster(fd);
-	if (err < 0)
+	if (err < 0 && errno != EINVAL)
 		return -errno;
 
 	screen = calloc(1, sizeof(*screen));
@@ -257,6 +400,40 @@ int screen_create(struct screen **screenp, int fd, unsigned int width,
 
 	screen->original_crtc = drmModeGetCrtc(screen->fd, screen->crtc);
 
+	/*
+	 * If the CRTC shows the preferred mode already, keep it, so that the
+	 * first frame and the restore on exit only need to replace the
+	 * framebuffer and the output does not go blank for a full modeset.
+	 * Any other mode, such as a console left at a lower resolution, is
+	 * replaced by a full modeset as before.
+	 */
+	if (screen->original_crtc && screen->original_crtc->mode_valid &&
+	    screen->original_crtc->buffer_id &&
+	    mode_equal(&screen->original_crtc->mode, &screen->mode))
+		screen->reuse_mode = true;
+
+	/*
+	 * Save the original gamma ramp so that it can be restored on exit,
+	 * colour themes are applied by reprogramming it.
+	 */
+	if (screen->original_crtc && screen->original_crtc->gamma_size > 0) {
+		unsigned int size = screen->original_crtc->gamma_size;
+
+		screen->gamma = calloc(3 * size, sizeof(uint16_t));
+		if (screen->gamma) {
+			err = drmModeCrtcGetGamma(screen->fd, screen->crtc,
+						  size, screen->gamma,
+						  screen->gamma + size,
+						  screen->gamma + 2 * size);
+			if (err < 0) {
+				free(screen->gamma);
+				screen->gamma = NULL;
+			} else {
+				screen->gamma_size = size;
+			}
+		}
+	}
+
 	if (!width || !height) {
 		screen->width = screen->mode.hdisplay;
 		screen->height = screen->mode.vdisplay;
@@ -287,10 +464,28 @@ int screen_free(struct screen *screen)
 	if (!screen)
 		return -EINVAL;
 
+	if (screen->gamma) {
+		unsigned int size = screen->gamma_size;
+
+		drmModeCrtcSetGamma(screen->fd, screen->crtc, size,
+				    screen->gamma, screen->gamma + size,
+				    screen->gamma + 2 * size);
+		free(screen->gamma);
+	}
+
+	screen_wait(screen);
+
 	crtc = screen->original_crtc;
-	drmModeSetCrtc(screen->fd, crtc->crtc_id, crtc->buffer_id, crtc->x,
-		       crtc->y, &screen->connector, 1, &crtc->mode);
-	drmModeFreeCrtc(crtc);
+	if (crtc) {
+		if (!screen->reuse_mode || !screen->mode_set ||
+		    screen_show(screen, crtc->buffer_id) < 0 ||
+		    screen_wait(screen) < 0)
+			drmModeSetCrtc(screen->fd, crtc->crtc_id,
+				       crtc->buffer_id, crtc->x, crtc->y,
+				       &screen->connector, 1, &crtc->mode);
+
+		drmModeFreeCrtc(crtc);
+	}
 
 	for (i = 0; i < 2; i++)
 		surface_destroy(screen->fb[i]);
@@ -301,38 +496,367 @@ int screen_free(struct screen *screen)
 	return 0;
 }
 
+static void screen_present(struct screen *screen, unsigned int sequence)
+{
+	if (screen->presented && sequence - screen->sequence > 1)
+		screen->dropped += sequence - screen->sequence - 1;
+
+	screen->sequence = sequence;
+	screen->presented++;
+}
+
+static int screen_get_vblank(struct screen *screen, unsigned int *sequence)
+{
+	drmVBlank vbl;
+
+	memset(&vbl, 0, sizeof(vbl));
+	vbl.request.type = DRM_VBLANK_RELATIVE |
+			   (screen->pipe << DRM_VBLANK_HIGH_CRTC_SHIFT);
+
+	if (drmWaitVBlank(screen->fd, &vbl) < 0)
+		return -errno;
+
+	*sequence = vbl.reply.sequence;
+
+	return 0;
+}
+
+/*
+ * Waits for the next vertical blank of the CRTC. The timestamp is that of
+ * the start of scanout of the following frame, on the monotonic clock.
+ */
+int screen_wait_vblank(struct screen *screen, unsigned int *sequence,
+		       struct timespec *timestamp)
+{
+	drmVBlank vbl;
+
+	if (!screen)
+		return -EINVAL;
+
+	memset(&vbl, 0, sizeof(vbl));
+	vbl.request.type = DRM_VBLANK_RELATIVE |
+			   (screen->pipe << DRM_VBLANK_HIGH_CRTC_SHIFT);
+	vbl.request.sequence = 1;
+
+	if (drmWaitVBlank(screen->fd, &vbl) < 0)
+		return -errno;
+
+	*sequence = vbl.reply.sequence;
+	timestamp->tv_sec = vbl.reply.tval_sec;
+	timestamp->tv_nsec = vbl.reply.tval_usec * 1000;
+
+	return 0;
+}
+
+/*
+ * Atomic commits only need the ID of the primary plane of the CRTC and of
+ * its FB_ID property. Enabling atomic modesetting also exposes the primary
+ * and cursor planes.
+ */
+int screen_set_swap_mode(struct screen *screen, enum screen_swap_mode mode)
+{
+	drmModePlaneRes *res;
+	drmModePlane *plane;
+	uint64_t type;
+	uint32_t i;
+	int err;
+
+	if (!screen)
+		return -EINVAL;
+
+	if (mode == SCREEN_SWAP_ATOMIC && !screen->plane) {
+		err = drmSetClientCap(screen->fd, DRM_CLIENT_CAP_ATOMIC, 1);
+		if (err < 0)
+			return -errno;
+
+		res = drmModeGetPlaneResources(screen->fd);
+		if (!res)
+			return -ENODEV;
+
+		for (i = 0; i < res->count_planes && !screen->plane; i++) {
+			plane = drmModeGetPlane(screen->fd, res->planes[i]);
+			if (!plane)
+				continue;
+
+			if ((plane->possible_crtcs & (1 << screen->pipe)) &&
+			    object_get_property(screen->fd, plane->plane_id,
+						DRM_MODE_OBJECT_PLANE, "type",
+						&type) &&
+			    type == DRM_PLANE_TYPE_PRIMARY)
+				screen->plane = plane->plane_id;
+
+			drmModeFreePlane(plane);
+		}
+
+		drmModeFreePlaneResources(res);
+
+		if (!screen->plane)
+			return -ENODEV;
+
+		screen->fb_id = object_get_property(screen->fd, screen->plane,
+						    DRM_MODE_OBJECT_PLANE,
+						    "FB_ID", NULL);
+		if (!screen->fb_id) {
+			screen->plane = 0;
+			return -ENODEV;
+		}
+	}
+
+	screen->swap_mode = mode;
+
+	return 0;
+}
+
+/*
+ * Presents the back buffer. Page flips and atomic commits wait for the
+ * new frame to be scanned out, after which the former front buffer is no
+ * longer in use and can be drawn to.
+ */
 int screen_swap(struct screen *screen)
 {
-	struct surface *fb = screen->fb[screen->current];
+	unsigned int sequence = 0;
+	struct surface *fb;
 	int err;
 
 	if (!screen)
 		return -EINVAL;
 
+	fb = screen->fb[screen->current];
+
+	/*
+	 * The first frame is shown without a modeset as well if the mode is
+	 * kept, unless the driver refuses to, e.g. because the framebuffer
+	 * of the previous master has a different format.
+	 */
+	if ((screen->swap_mode != SCREEN_SWAP_SETCRTC && screen->mode_set) ||
+	    (screen->reuse_mode && !screen->mode_set)) {
+		err = screen_show(screen, fb->id);
+		if (err == 0) {
+			screen->mode_set = true;
+			screen->current ^= 1;
+			return screen_wait(screen);
+		}
+
+		if (screen->mode_set)
+			return err;
+
+		screen->reuse_mode = false;
+	}
+
 	err = drmModeSetCrtc(screen->fd, screen->crtc, fb->id, 0, 0,
 			     &screen->connector, 1, &screen->mode);
 	if (err < 0)
 		return -errno;
 
+	screen->mode_set = true;
 	screen->current ^= 1;
 
+	if (screen_get_vblank(screen, &sequence) == 0)
+		screen_present(screen, sequence);
+	else
+		screen->presented++;
+
+	return 0;
+}
+
+/*
+ * Scans out a surface, which may be larger than the mode, starting at the
+ * given offset. Without a change of the mode this only moves the source
+ * offset of the primary plane, so nothing needs to be redrawn.
+ */
+int screen_pan(struct screen *screen, struct surface *fb, unsigned int x,
+	       unsigned int y)
+{
+	int err;
+
+	if (!screen || !fb)
+		return -EINVAL;
+
+	err = drmModeSetCrtc(screen->fd, screen->crtc, fb->id, x, y,
+			     &screen->connector, 1, &screen->mode);
+	if (err < 0)
+		return -errno;
+
 	return 0;
 }
 
 int screen_flip(struct screen *screen)
 {
-	struct surface *fb = screen->fb[screen->current];
+	struct surface *fb;
 	int err;
 
 	if (!screen)
 		return -EINVAL;
 
+	fb = screen->fb[screen->current];
+
 	err = drmModePageFlip(screen->fd, screen->crtc, fb->id,
 			      DRM_MODE_PAGE_FLIP_EVENT, screen);
 	if (err < 0)
 		return -errno;
 
+	screen->pending = true;
 	screen->current ^= 1;
 
 	return 0;
 }
+
+static void screen_flip_handler(int fd, unsigned int sequence,
+				unsigned int sec, unsigned int usec,
+				void *data)
+{
+	struct screen *screen = data;
+
+	screen_present(screen, sequence);
+	screen->pending = false;
+}
+
+/* Waits for a pending page flip or atomic commit to complete. */
+int screen_wait(struct screen *screen)
+{
+	drmEventContext context = {
+		.version = DRM_EVENT_CONTEXT_VERSION,
+		.page_flip_handler = screen_flip_handler,
+	};
+
+	if (!screen)
+		return -EINVAL;
+
+	while (screen->pending) {
+		if (drmHandleEvent(screen->fd, &context) < 0 &&
+		    errno != EINTR)
+			return -errno;
+	}
+
+	return 0;
+}
+
+int screen_set_gamma(struct screen *screen, uint16_t *red, uint16_t *green,
+		     uint16_t *blue)
+{
+	int err;
+
+	if (!screen)
+		return -EINVAL;
+
+	if (!screen->gamma_size)
+		return -ENOTSUP;
+
+	err = drmModeCrtcSetGamma(screen->fd, screen->crtc, screen->gamma_size,
+				  red, green, blue);
+	if (err < 0)
+		return -errno;
+
+	return 0;
+}
+
+static bool plane_supports_format(drmModePlane *plane, uint32_t format)
+{
+	uint32_t i;
+
+	for (i = 0; i < plane->count_formats; i++)
+		if (plane->formats[i] == format)
+			return true;
+
+	return false;
+}
+
+/*
+ * Without the universal planes client capability only overlay planes are
+ * reported, which is exactly the set that can be used without disturbing
+ * the primary plane. Atomic modesetting implies that capability, so the
+ * type of the planes is checked as well.
+ */
+int plane_create(struct plane **planep, struct screen *screen,
+		 unsigned int width, unsigned int height, uint32_t format)
+{
+	drmModePlaneRes *res;
+	struct plane *plane;
+	uint32_t i, id = 0;
+	uint64_t type;
+	int err;
+
+	if (!screen)
+		return -EINVAL;
+
+	res = drmModeGetPlaneResources(screen->fd);
+	if (!res)
+		return -ENODEV;
+
+	for (i = 0; i < res->count_planes; i++) {
+		drmModePlane *p;
+
+		p = drmModeGetPlane(screen->fd, res->planes[i]);
+		if (!p)
+			continue;
+
+		if ((p->possible_crtcs & (1 << screen->pipe)) && !p->crtc_id &&
+		    plane_supports_format(p, format) &&
+		    (!object_get_property(screen->fd, p->plane_id,
+					  DRM_MODE_OBJECT_PLANE, "type",
+					  &type) ||
+		     type == DRM_PLANE_TYPE_OVERLAY))
+			id = p->plane_id;
+
+		drmModeFreePlane(p);
+
+		if (id)
+			break;
+	}
+
+	drmModeFreePlaneResources(res);
+
+	if (!id)
+		return -ENODEV;
+
+	plane = calloc(1, sizeof(*plane));
+	if (!plane)
+		return -ENOMEM;
+
+	plane->screen = screen;
+	plane->id = id;
+
+	err = surface_create_with_format(&plane->fb, screen, width, height,
+					 format);
+	if (err < 0) {
+		free(plane);
+		return err;
+	}
+
+	*planep = plane;
+
+	return 0;
+}
+
+int plane_free(struct plane *plane)
+{
+	if (!plane)
+		return -EINVAL;
+
+	drmModeSetPlane(plane->screen->fd, plane->id, 0, 0, 0, 0, 0, 0, 0, 0,
+			0, 0, 0);
+	surface_destroy(plane->fb);
+	free(plane);
+
+	return 0;
+}
+
+int plane_show(struct plane *plane, int x, int y)
+{
+	struct surface *fb;
+	int err;
+
+	if (!plane)
+		return -EINVAL;
+
+	fb = plane->fb;
+
+	err = drmModeSetPlane(plane->screen->fd, plane->id,
+			      plane->screen->crtc, fb->id, 0, x, y, fb->width,
+			      fb->height, 0, 0, fb->width << 16,
+			      fb->height << 16);
+	if (err < 0)
+		return -errno;
+
+	return 0;
+}
@@ -1,10 +1,13 @@
 #ifndef DRM_UTILS_H
 #define DRM_UTILS_H 1
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
+#include <drm_fourcc.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
@@ -36,10 +39,24 @@ struct surface {
 
 int surface_create(struct surface **surfacep, struct screen *screen,
 		   unsigned int width, unsigned int height, unsigned int bpp);
+int surface_create_with_format(struct surface **surfacep,
+			       struct screen *screen, unsigned int width,
+			       unsigned int height, uint32_t format);
 int surface_destroy(struct surface *surface);
 int surface_lock(struct surface *surface, void **ptr);
 int surface_unlock(struct surface *surface);
 
+/*
+ * How frames are presented: with a modeset for every frame, as page flips
+ * or as atomic commits of the primary plane. The latter two are paced by
+ * vertical blanking, the first frame always sets the mode.
+ */
+enum screen_swap_mode {
+	SCREEN_SWAP_SETCRTC,
+	SCREEN_SWAP_FLIP,
+	SCREEN_SWAP_ATOMIC,
+};
+
 struct screen {
 	drmModeCrtcPtr original_crtc;
 	drmModeModeInfo mode;
@@ -51,12 +68,51 @@ struct screen {
 	struct surface *fb[2];
 	unsigned int current;
 	int fd;
+
+	unsigned int gamma_size;
+	uint16_t *gamma;
+
+	enum screen_swap_mode swap_mode;
+	bool reuse_mode;
+	bool mode_set;
+	bool pending;
+	uint32_t plane;
+	uint32_t fb_id;
+
+	/* presentation statistics, in vertical blanking periods */
+	unsigned int sequence;
+	unsigned long presented;
+	unsigned long dropped;
 };
 
+uint32_t object_get_property(int fd, uint32_t id, uint32_t type,
+			     const char *name, uint64_t *value);
+int connector_find_crtc(int fd, drmModeRes *res, drmModeConnector *connector,
+			uint32_t busy);
+
 int screen_create(struct screen **screenp, int fd, unsigned int width,
 		  unsigned int height);
 int screen_free(struct screen *screen);
+int screen_set_swap_mode(struct screen *screen, enum screen_swap_mode mode);
 int screen_swap(struct screen *screen);
 int screen_flip(struct screen *screen);
+int screen_wait(struct screen *screen);
+int screen_wait_vblank(struct screen *screen, unsigned int *sequence,
+		       struct timespec *timestamp);
+int screen_pan(struct screen *screen, struct surface *fb, unsigned int x,
+	       unsigned int y);
+int screen_set_gamma(struct screen *screen, uint16_t *red, uint16_t *green,
+		     uint16_t *blue);
+
+struct plane {
+	struct screen *screen;
+	struct surface *fb;
+	uint32_t id;
+};
+
+int plane_create(struct plane **planep, struct screen *screen,
+		 unsigned int width, unsigned int height, uint32_t format);
+int plane_free(struct plane *plane);
+int plane_show(struct plane *plane, int x, int y);
 
 #endif /* DRM_UTILS_H */
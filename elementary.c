@@ -0,0 +1,138 @@
+#include <endian.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elementary.h"
+
+/* parses Golly's notation for elementary rules, "W" and the rule number */
+int elementary_parse_rule(uint8_t *rule, const char *string)
+{
+	unsigned long value;
+	char *end;
+
+	if (*string != 'W' && *string != 'w')
+		return -EINVAL;
+
+	value = strtoul(string + 1, &end, 10);
+	if (end == string + 1 || *end || value > 255)
+		return -EINVAL;
+
+	*rule = value;
+
+	return 0;
+}
+
+int elementary_create(struct elementary **elementaryp, uint8_t rule,
+		      unsigned int width)
+{
+	struct elementary *elementary;
+
+	if (!width)
+		return -EINVAL;
+
+	elementary = calloc(1, sizeof(*elementary));
+	if (!elementary)
+		return -ENOMEM;
+
+	elementary->rule = rule;
+	elementary->width = width;
+	elementary->words = (width + 63) / 64;
+	elementary->mask = ~0ull >> (elementary->words * 64 - width);
+
+	elementary->cells = calloc(elementary->words, sizeof(uint64_t));
+	elementary->next = calloc(elementary->words, sizeof(uint64_t));
+
+	if (!elementary->cells || !elementary->next) {
+		elementary_free(elementary);
+		return -ENOMEM;
+	}
+
+	*elementaryp = elementary;
+
+	return 0;
+}
+
+int elementary_free(struct elementary *elementary)
+{
+	if (!elementary)
+		return -EINVAL;
+
+	free(elementary->next);
+	free(elementary->cells);
+	free(elementary);
+
+	return 0;
+}
+
+void elementary_from_linear(struct elementary *elementary, const void *src)
+{
+	unsigned int last = elementary->words - 1;
+
+	memcpy(elementary->cells, src, elementary->words * sizeof(uint64_t));
+	elementary->cells[last] &= htole64(elementary->mask);
+}
+
+void elementary_randomize(struct elementary *elementary, unsigned int seed)
+{
+	unsigned int x;
+
+	memset(elementary->cells, 0, elementary->words * sizeof(uint64_t));
+
+	for (x = 0; x < elementary->width; x++)
+		if (rand_r(&seed) > RAND_MAX / 2)
+			elementary->cells[x / 64] |= htole64(1ull << (x % 64));
+}
+
+/*
+ * Applies the rule to 64 cells at a time: each of the eight neighbourhood
+ * patterns is matched with two ANDs and contributes if its bit of the rule
+ * number is set.
+ */
+static inline uint64_t elementary_apply(uint8_t rule, uint64_t left,
+					uint64_t center, uint64_t right)
+{
+	uint64_t next = 0, match;
+	unsigned int p;
+
+	for (p = 0; p < 8; p++) {
+		match = (p & 4 ? left : ~left) & (p & 2 ? center : ~center) &
+			(p & 1 ? right : ~right);
+		next |= match & -(uint64_t)((rule >> p) & 1);
+	}
+
+	return next;
+}
+
+void elementary_tick(struct elementary *elementary)
+{
+	unsigned int last = elementary->words - 1, i;
+	unsigned int msb = (elementary->width - 1) % 64;
+	uint64_t word, left, right, *tmp;
+
+	for (i = 0; i <= last; i++) {
+		word = le64toh(elementary->cells[i]);
+		left = word << 1;
+		right = word >> 1;
+
+		if (i > 0)
+			left |= le64toh(elementary->cells[i - 1]) >> 63;
+		else
+			left |= (le64toh(elementary->cells[last]) >> msb) & 1;
+
+		if (i < last)
+			right |= le64toh(elementary->cells[i + 1]) << 63;
+		else
+			right |= (le64toh(elementary->cells[0]) & 1) << msb;
+
+		word = elementary_apply(elementary->rule, left, word, right);
+		if (i == last)
+			word &= elementary->mask;
+
+		elementary->next[i] = htole64(word);
+	}
+
+	tmp = elementary->cells;
+	elementary->cells = elementary->next;
+	elementary->next = tmp;
+}
@@ -0,0 +1,31 @@
+#ifndef ELEMENTARY_H
+#define ELEMENTARY_H 1
+
+#include <stdint.h>
+
+/*
+ * One-dimensional automaton on a ring of cells, with Wolfram's elementary
+ * rules such as "W30" or "W110": bit p of the rule number is the next
+ * state of a cell whose left neighbour, itself and right neighbour form
+ * the bits 2, 1 and 0 of p. Cells are stored in the same layout as a row
+ * of a two-state universe.
+ */
+struct elementary {
+	uint8_t rule;
+	unsigned int width;
+	unsigned int words;
+	uint64_t mask;
+
+	uint64_t *cells;
+	uint64_t *next;
+};
+
+int elementary_parse_rule(uint8_t *rule, const char *string);
+int elementary_create(struct elementary **elementaryp, uint8_t rule,
+		      unsigned int width);
+int elementary_free(struct elementary *elementary);
+void elementary_from_linear(struct elementary *elementary, const void *src);
+void elementary_randomize(struct elementary *elementary, unsigned int seed);
+void elementary_tick(struct elementary *elementary);
+
+#endif /* ELEMENTARY_H */
@@ -0,0 +1,187 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ensemble.h"
+#include "life.h"
+
+int ensemble_create(struct ensemble **ensemblep, unsigned int width,
+		    unsigned int height)
+{
+	struct ensemble *ensemble;
+	size_t size;
+
+	if (!width || !height)
+		return -EINVAL;
+
+	ensemble = calloc(1, sizeof(*ensemble));
+	if (!ensemble)
+		return -ENOMEM;
+
+	ensemble->width = width;
+	ensemble->height = height;
+
+	/* a multiple of the alignment since ENSEMBLE_HISTORY is 16 */
+	size = (size_t)width * height * ENSEMBLE_HISTORY * sizeof(uint64_t);
+
+	ensemble->states = aligned_alloc(64, size);
+	if (!ensemble->states) {
+		free(ensemble);
+		return -ENOMEM;
+	}
+
+	memset(ensemble->states, 0, size);
+
+	*ensemblep = ensemble;
+
+	return 0;
+}
+
+int ensemble_free(struct ensemble *ensemble)
+{
+	if (!ensemble)
+		return -EINVAL;
+
+	free(ensemble->changes);
+	free(ensemble->states);
+	free(ensemble);
+
+	return 0;
+}
+
+/* uses the same sequence as randomizing a grid of the same size */
+void ensemble_randomize(struct ensemble *ensemble, unsigned int lane,
+			unsigned int seed)
+{
+	unsigned int x, y;
+
+	for (y = 0; y < ensemble->height; y++)
+		for (x = 0; x < ensemble->width; x++)
+			if (rand_r(&seed) > RAND_MAX / 2)
+				ensemble_set(ensemble, x, y, lane);
+}
+
+/*
+ * Each band also records, for every earlier generation still in the ring,
+ * which lanes differ from the new generation. A lane that does not differ
+ * from the generation p steps back has become periodic with period p.
+ */
+static void ensemble_tick_band(void *data, unsigned int index,
+			       unsigned int count)
+{
+	struct ensemble *ensemble = data;
+	unsigned int width = ensemble->width, height = ensemble->height;
+	unsigned int rows = (height + count - 1) / count;
+	unsigned int start = index * rows, end = start + rows;
+	unsigned int gen = ensemble->generation + 1, periods, p, x, y;
+	uint64_t *changes = ensemble->changes + index * ENSEMBLE_HISTORY;
+	const uint64_t *src = ensemble_cells(ensemble, gen - 1);
+	uint64_t *dst = ensemble_cells(ensemble, gen);
+
+	/* nothing to compare against in the first generations */
+	periods = gen < ENSEMBLE_HISTORY ? gen : ENSEMBLE_HISTORY - 1;
+
+	memset(changes, 0, ENSEMBLE_HISTORY * sizeof(*changes));
+
+	if (end > height)
+		end = height;
+
+	/* lanes that are already known to be periodic need no checks */
+	if (!~ensemble->stable)
+		periods = 0;
+
+	for (y = start; y < end; y++) {
+		const uint64_t *above, *row, *below;
+		uint64_t *out = dst + y * width;
+
+		above = src + ((y + height - 1) % height) * width;
+		row = src + y * width;
+		below = src + ((y + 1) % height) * width;
+
+		for (x = 0; x < width; x++) {
+			unsigned int l = (x + width - 1) % width;
+			unsigned int r = (x + 1) % width;
+			uint64_t next;
+
+			next = life_next(above[l], above[x], above[r],
+					 row[l], row[x], row[r],
+					 below[l], below[x], below[r]);
+			out[x] = next;
+
+			for (p = 1; p <= periods; p++) {
+				const uint64_t *old;
+
+				old = ensemble_cells(ensemble, gen - p);
+				changes[p] |= next ^ old[y * width + x];
+			}
+		}
+	}
+}
+
+int ensemble_tick(struct ensemble *ensemble, struct pool *pool)
+{
+	unsigned int lane, p, i;
+	uint64_t same;
+
+	if (ensemble->threads < pool->count) {
+		uint64_t *changes;
+
+		changes = realloc(ensemble->changes, pool->count *
+				  ENSEMBLE_HISTORY * sizeof(*changes));
+		if (!changes)
+			return -ENOMEM;
+
+		ensemble->changes = changes;
+		ensemble->threads = pool->count;
+	}
+
+	pool_run(pool, ensemble_tick_band, ensemble);
+	ensemble->generation++;
+
+	for (p = 1; p < ENSEMBLE_HISTORY && p <= ensemble->generation; p++) {
+		same = ~ensemble->stable;
+
+		for (i = 0; i < pool->count; i++)
+			same &= ~ensemble->changes[i * ENSEMBLE_HISTORY + p];
+
+		while (same) {
+			lane = __builtin_ctzll(same);
+			same &= same - 1;
+
+			ensemble->period[lane] = p;
+			ensemble->settled[lane] = ensemble->generation - p;
+			ensemble->stable |= 1ull << lane;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * The populations of all lanes are accumulated in bit-sliced counters,
+ * one word per binary digit, which takes only a few operations per cell
+ * regardless of the number of lanes.
+ */
+void ensemble_population(struct ensemble *ensemble,
+			 unsigned long *population)
+{
+	const uint64_t *cells = ensemble_cells(ensemble, ensemble->generation);
+	size_t size = (size_t)ensemble->width * ensemble->height, i;
+	uint64_t counters[64] = { 0 }, carry, t;
+	unsigned int lane, bit;
+
+	for (i = 0; i < size; i++) {
+		for (carry = cells[i], bit = 0; carry; bit++) {
+			t = counters[bit] & carry;
+			counters[bit] ^= carry;
+			carry = t;
+		}
+	}
+
+	for (lane = 0; lane < ENSEMBLE_LANES; lane++) {
+		population[lane] = 0;
+
+		for (bit = 0; bit < 64; bit++)
+			population[lane] |= ((counters[bit] >> lane) & 1) << bit;
+	}
+}
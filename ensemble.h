@@ -0,0 +1,71 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pool.h"
+
+#define ENSEMBLE_LANES 64
+
+/* generations kept, which also limits the periods that can be detected */
+#define ENSEMBLE_HISTORY 16
+
+/*
+ * 64 independent universes of the same size that are simulated together.
+ * Each cell is a word in which bit i belongs to universe (lane) i, so one
+ * pass of the bitwise neighbour-sum logic advances all of them at once.
+ */
+struct ensemble {
+	unsigned int width;
+	unsigned int height;
+	unsigned int generation;
+
+	/* ring of the most recent generations */
+	uint64_t *states;
+
+	/* lanes whose state has become periodic */
+	uint64_t stable;
+	unsigned int period[ENSEMBLE_LANES];
+	unsigned int settled[ENSEMBLE_LANES];
+
+	/* per-thread differences to the previous generations */
+	uint64_t *changes;
+	unsigned int threads;
+};
+
+int ensemble_create(struct ensemble **ensemblep, unsigned int width,
+		    unsigned int height);
+int ensemble_free(struct ensemble *ensemble);
+
+static inline uint64_t *ensemble_cells(struct ensemble *ensemble,
+				       unsigned int generation)
+{
+	size_t size = (size_t)ensemble->width * ensemble->height;
+
+	return ensemble->states + (generation % ENSEMBLE_HISTORY) * size;
+}
+
+static inline bool ensemble_get(struct ensemble *ensemble, unsigned int x,
+				unsigned int y, unsigned int lane)
+{
+	uint64_t *cells = ensemble_cells(ensemble, ensemble->generation);
+
+	return (cells[y * ensemble->width + x] >> lane) & 1;
+}
+
+static inline void ensemble_set(struct ensemble *ensemble, unsigned int x,
+				unsigned int y, unsigned int lane)
+{
+	uint64_t *cells = ensemble_cells(ensemble, ensemble->generation);
+
+	cells[y * ensemble->width + x] |= 1ull << lane;
+}
+
+void ensemble_randomize(struct ensemble *ensemble, unsigned int lane,
+			unsigned int seed);
+int ensemble_tick(struct ensemble *ensemble, struct pool *pool);
+void ensemble_population(struct ensemble *ensemble,
+			 unsigned long *population);
+
+#endif /* ENSEMBLE_H */
@@ -0,0 +1,498 @@
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fft.h"
+
+typedef float fft_vec __attribute__((vector_size(FFT_VECTOR * sizeof(float))));
+
+/* size of the tiles in which spectra are transposed */
+#define FFT_TILE 16
+
+#define FFT_AT(base, row, column, stride) \
+	((fft_vec *)((base) + (size_t)(row) * (stride) + (column)))
+
+int fft_create(struct fft **fftp, unsigned int size)
+{
+	unsigned int i, j, reverse;
+	struct fft *fft;
+
+	if (size < 2 || (size & (size - 1)))
+		return -EINVAL;
+
+	fft = calloc(1, sizeof(*fft));
+	if (!fft)
+		return -ENOMEM;
+
+	fft->size = size;
+
+	while ((1u << fft->log2) < size)
+		fft->log2++;
+
+	fft->reverse = calloc(size, sizeof(*fft->reverse));
+	fft->cos = calloc(size / 2, sizeof(*fft->cos));
+	fft->sin = calloc(size / 2, sizeof(*fft->sin));
+
+	if (!fft->reverse || !fft->cos || !fft->sin) {
+		fft_free(fft);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < size; i++) {
+		for (reverse = 0, j = 0; j < fft->log2; j++)
+			if (i & (1u << j))
+				reverse |= 1u << (fft->log2 - 1 - j);
+
+		fft->reverse[i] = reverse;
+	}
+
+	for (i = 0; i < size / 2; i++) {
+		fft->cos[i] = cos(2 * M_PI * i / size);
+		fft->sin[i] = sin(2 * M_PI * i / size);
+	}
+
+	*fftp = fft;
+
+	return 0;
+}
+
+int fft_free(struct fft *fft)
+{
+	if (!fft)
+		return -EINVAL;
+
+	free(fft->sin);
+	free(fft->cos);
+	free(fft->reverse);
+	free(fft);
+
+	return 0;
+}
+
+/*
+ * Transforms the columns start to end (multiples of FFT_VECTOR) of an
+ * array of fft->size rows, stride floats apart, in place. The columns are
+ * independent transforms, so every butterfly is applied to FFT_VECTOR of
+ * them at once. After the bit reversal, pairs of radix-2 stages are done
+ * as one radix-4 pass, which halves the passes over the data. Neither
+ * direction is normalised.
+ */
+void fft_batch(const struct fft *fft, float *re, float *im, size_t stride,
+	       unsigned int start, unsigned int end, bool inverse)
+{
+	float sign = inverse ? 1.0f : -1.0f;
+	unsigned int n = fft->size, h, i, j, q, c;
+	fft_vec tmp;
+
+	for (i = 0; i < n; i++) {
+		j = fft->reverse[i];
+		if (j <= i)
+			continue;
+
+		for (c = start; c < end; c += FFT_VECTOR) {
+			tmp = *FFT_AT(re, i, c, stride);
+			*FFT_AT(re, i, c, stride) = *FFT_AT(re, j, c, stride);
+			*FFT_AT(re, j, c, stride) = tmp;
+
+			tmp = *FFT_AT(im, i, c, stride);
+			*FFT_AT(im, i, c, stride) = *FFT_AT(im, j, c, stride);
+			*FFT_AT(im, j, c, stride) = tmp;
+		}
+	}
+
+	h = 1;
+
+	/* an odd number of stages leaves one radix-2 stage */
+	if (fft->log2 % 2) {
+		for (j = 0; j < n; j += 2) {
+			for (c = start; c < end; c += FFT_VECTOR) {
+				fft_vec *ar = FFT_AT(re, j, c, stride);
+				fft_vec *ai = FFT_AT(im, j, c, stride);
+				fft_vec *br = FFT_AT(re, j + 1, c, stride);
+				fft_vec *bi = FFT_AT(im, j + 1, c, stride);
+				fft_vec r = *ar, i = *ai;
+
+				*ar = r + *br;
+				*ai = i + *bi;
+				*br = r - *br;
+				*bi = i - *bi;
+			}
+		}
+
+		h = 2;
+	}
+
+	for (; h < n; h *= 4) {
+		for (q = 0; q < h; q++) {
+			float w1r = fft->cos[q * (n / (2 * h))];
+			float w1i = sign * fft->sin[q * (n / (2 * h))];
+			float w2r = fft->cos[q * (n / (4 * h))];
+			float w2i = sign * fft->sin[q * (n / (4 * h))];
+			float w3r = -sign * w2i, w3i = sign * w2r;
+
+			for (j = q; j < n; j += 4 * h) {
+				for (c = start; c < end; c += FFT_VECTOR) {
+					fft_vec *x0r = FFT_AT(re, j, c, stride);
+					fft_vec *x0i = FFT_AT(im, j, c, stride);
+					fft_vec *x1r = FFT_AT(re, j + h, c, stride);
+					fft_vec *x1i = FFT_AT(im, j + h, c, stride);
+					fft_vec *x2r = FFT_AT(re, j + 2 * h, c, stride);
+					fft_vec *x2i = FFT_AT(im, j + 2 * h, c, stride);
+					fft_vec *x3r = FFT_AT(re, j + 3 * h, c, stride);
+					fft_vec *x3i = FFT_AT(im, j + 3 * h, c, stride);
+					fft_vec t1r, t1i, t3r, t3i, t2r, t2i, t4r, t4i;
+					fft_vec b0r, b0i, b1r, b1i, b2r, b2i, b3r, b3i;
+
+					t1r = *x1r * w1r - *x1i * w1i;
+					t1i = *x1r * w1i + *x1i * w1r;
+					t3r = *x3r * w1r - *x3i * w1i;
+					t3i = *x3r * w1i + *x3i * w1r;
+
+					b0r = *x0r + t1r;
+					b0i = *x0i + t1i;
+					b1r = *x0r - t1r;
+					b1i = *x0i - t1i;
+					b2r = *x2r + t3r;
+					b2i = *x2i + t3i;
+					b3r = *x2r - t3r;
+					b3i = *x2i - t3i;
+
+					t2r = b2r * w2r - b2i * w2i;
+					t2i = b2r * w2i + b2i * w2r;
+					t4r = b3r * w3r - b3i * w3i;
+					t4i = b3r * w3i + b3i * w3r;
+
+					*x0r = b0r + t2r;
+					*x0i = b0i + t2i;
+					*x2r = b0r - t2r;
+					*x2i = b0i - t2i;
+					*x1r = b1r + t4r;
+					*x1i = b1i + t4i;
+					*x3r = b1r - t4r;
+					*x3i = b1i - t4i;
+				}
+			}
+		}
+	}
+}
+
+/* zeroed memory for count floats, aligned for vector loads */
+float *fft_alloc(size_t count)
+{
+	size_t size = (count * sizeof(float) + 63) & ~(size_t)63;
+	float *ptr;
+
+	ptr = aligned_alloc(64, size);
+	if (ptr)
+		memset(ptr, 0, size);
+
+	return ptr;
+}
+
+int fft2_create(struct fft2 **fftp, unsigned int width, unsigned int height)
+{
+	struct fft2 *fft;
+	unsigned int k;
+	int err;
+
+	if (width < FFT_VECTOR || (width & (width - 1)) || height < 4 ||
+	    (height & (height - 1)))
+		return -EINVAL;
+
+	fft = calloc(1, sizeof(*fft));
+	if (!fft)
+		return -ENOMEM;
+
+	fft->width = width;
+	fft->height = height;
+	fft->bins = height / 2 + 1;
+	fft->stride = (fft->bins + FFT_VECTOR - 1) / FFT_VECTOR * FFT_VECTOR;
+
+	err = fft_create(&fft->columns, height / 2);
+	if (err < 0)
+		goto free;
+
+	err = fft_create(&fft->rows, width);
+	if (err < 0)
+		goto free;
+
+	err = -ENOMEM;
+
+	fft->cos = calloc(fft->bins, sizeof(*fft->cos));
+	fft->sin = calloc(fft->bins, sizeof(*fft->sin));
+	fft->re = fft_alloc((size_t)fft->bins * width);
+	fft->im = fft_alloc((size_t)fft->bins * width);
+
+	if (!fft->cos || !fft->sin || !fft->re || !fft->im)
+		goto free;
+
+	for (k = 0; k < fft->bins; k++) {
+		fft->cos[k] = cos(2 * M_PI * k / height);
+		fft->sin[k] = sin(2 * M_PI * k / height);
+	}
+
+	*fftp = fft;
+
+	return 0;
+
+free:
+	fft2_free(fft);
+	return err;
+}
+
+int fft2_free(struct fft2 *fft)
+{
+	if (!fft)
+		return -EINVAL;
+
+	free(fft->im);
+	free(fft->re);
+	free(fft->sin);
+	free(fft->cos);
+
+	if (fft->rows)
+		fft_free(fft->rows);
+
+	if (fft->columns)
+		fft_free(fft->columns);
+
+	free(fft);
+
+	return 0;
+}
+
+/* splits size columns into one range of whole vectors per thread */
+static void fft_band(size_t size, unsigned int index, unsigned int count,
+		     unsigned int *start, unsigned int *end)
+{
+	unsigned int groups = size / FFT_VECTOR;
+	unsigned int per = (groups + count - 1) / count;
+
+	*start = index * per;
+	*end = *start + per;
+
+	if (*start > groups)
+		*start = groups;
+
+	if (*end > groups)
+		*end = groups;
+
+	*start *= FFT_VECTOR;
+	*end *= FFT_VECTOR;
+}
+
+/*
+ * The even and odd rows of a real field are transformed together as the
+ * real and imaginary parts of one half-size transform Z. Its bins k and
+ * half - k are then split into those of the even rows (E) and odd rows
+ * (O), which give bin k of the field as E[k] + W^k O[k].
+ */
+static inline void fft2_split(const fft_vec *zr, const fft_vec *zi,
+			      const fft_vec *lr, const fft_vec *li, float c,
+			      float s, fft_vec *xr, fft_vec *xi)
+{
+	fft_vec er = (*zr + *lr) * 0.5f, ei = (*zi - *li) * 0.5f;
+	fft_vec our = (*zi + *li) * 0.5f, oi = (*lr - *zr) * 0.5f;
+
+	*xr = er + c * our + s * oi;
+	*xi = ei + c * oi - s * our;
+}
+
+/* the reverse of fft2_split(), recombining E and O into Z */
+static inline void fft2_merge(const fft_vec *xr, const fft_vec *xi,
+			      const fft_vec *yr, const fft_vec *yi, float c,
+			      float s, fft_vec *zr, fft_vec *zi)
+{
+	fft_vec er = (*xr + *yr) * 0.5f, ei = (*xi - *yi) * 0.5f;
+	fft_vec dr = (*xr - *yr) * 0.5f, di = (*xi + *yi) * 0.5f;
+	fft_vec our = dr * c - di * s, oi = dr * s + di * c;
+
+	*zr = er - oi;
+	*zi = ei + our;
+}
+
+/*
+ * Copies element j of the rows i0 to i1 of src to element i of the rows j0
+ * to j1 of dst, one tile at a time so that the rows of both sides that are
+ * being accessed stay in the cache.
+ */
+static void fft2_transpose(float *dst, size_t dst_stride, const float *src,
+			   size_t src_stride, unsigned int i0, unsigned int i1,
+			   unsigned int j0, unsigned int j1)
+{
+	unsigned int i, j, ii, jj, iend, jend;
+
+	for (ii = i0; ii < i1; ii += FFT_TILE) {
+		iend = i1 - ii < FFT_TILE ? i1 : ii + FFT_TILE;
+
+		for (jj = j0; jj < j1; jj += FFT_TILE) {
+			jend = j1 - jj < FFT_TILE ? j1 : jj + FFT_TILE;
+
+			for (i = ii; i < iend; i++)
+				for (j = jj; j < jend; j++)
+					dst[j * dst_stride + i] =
+						src[i * src_stride + j];
+		}
+	}
+}
+
+static void fft2_columns_forward(void *data, unsigned int index,
+				 unsigned int count)
+{
+	struct fft2 *fft = data;
+	unsigned int width = fft->width, half = fft->height / 2;
+	unsigned int start, end, c, k, l;
+	fft_vec zr, zi, lr, li;
+
+	fft_band(width, index, count, &start, &end);
+	if (start == end)
+		return;
+
+	for (k = 0; k < half; k++) {
+		memcpy(fft->re + (size_t)k * width + start,
+		       fft->field + (size_t)2 * k * width + start,
+		       (end - start) * sizeof(float));
+		memcpy(fft->im + (size_t)k * width + start,
+		       fft->field + (size_t)(2 * k + 1) * width + start,
+		       (end - start) * sizeof(float));
+	}
+
+	fft_batch(fft->columns, fft->re, fft->im, width, start, end, false);
+
+	for (k = 0; k <= half / 2; k++) {
+		for (c = start; c < end; c += FFT_VECTOR) {
+			l = k ? half - k : 0;
+
+			zr = *FFT_AT(fft->re, k, c, width);
+			zi = *FFT_AT(fft->im, k, c, width);
+			lr = *FFT_AT(fft->re, l, c, width);
+			li = *FFT_AT(fft->im, l, c, width);
+
+			fft2_split(&zr, &zi, &lr, &li, fft->cos[k], fft->sin[k],
+				   FFT_AT(fft->re, k, c, width),
+				   FFT_AT(fft->im, k, c, width));
+			fft2_split(&lr, &li, &zr, &zi, fft->cos[half - k],
+				   fft->sin[half - k],
+				   FFT_AT(fft->re, half - k, c, width),
+				   FFT_AT(fft->im, half - k, c, width));
+		}
+	}
+}
+
+static void fft2_rows_forward(void *data, unsigned int index,
+			      unsigned int count)
+{
+	struct fft2 *fft = data;
+	unsigned int start, end, last;
+
+	fft_band(fft->stride, index, count, &start, &end);
+	if (start == end)
+		return;
+
+	last = end < fft->bins ? end : fft->bins;
+
+	fft2_transpose(fft->spectrum_re, fft->stride, fft->re, fft->width,
+		       start, last, 0, fft->width);
+	fft2_transpose(fft->spectrum_im, fft->stride, fft->im, fft->width,
+		       start, last, 0, fft->width);
+
+	fft_batch(fft->rows, fft->spectrum_re, fft->spectrum_im, fft->stride,
+		  start, end, false);
+}
+
+/*
+ * Computes the spectrum of a real field of height rows of width floats.
+ * The columns are transformed first, the rows of the resulting half
+ * spectrum are then transposed so that their transforms can be batched
+ * in the same way.
+ */
+void fft2_forward(struct fft2 *fft, struct pool *pool, const float *src,
+		  float *re, float *im)
+{
+	fft->field = (float *)src;
+	fft->spectrum_re = re;
+	fft->spectrum_im = im;
+
+	pool_run(pool, fft2_columns_forward, fft);
+	pool_run(pool, fft2_rows_forward, fft);
+}
+
+static void fft2_rows_inverse(void *data, unsigned int index,
+			      unsigned int count)
+{
+	struct fft2 *fft = data;
+	unsigned int start, end, last;
+
+	fft_band(fft->stride, index, count, &start, &end);
+	if (start == end)
+		return;
+
+	fft_batch(fft->rows, fft->spectrum_re, fft->spectrum_im, fft->stride,
+		  start, end, true);
+
+	last = end < fft->bins ? end : fft->bins;
+
+	fft2_transpose(fft->re, fft->width, fft->spectrum_re, fft->stride,
+		       0, fft->width, start, last);
+	fft2_transpose(fft->im, fft->width, fft->spectrum_im, fft->stride,
+		       0, fft->width, start, last);
+}
+
+static void fft2_columns_inverse(void *data, unsigned int index,
+				 unsigned int count)
+{
+	struct fft2 *fft = data;
+	unsigned int width = fft->width, half = fft->height / 2;
+	unsigned int start, end, c, k;
+	fft_vec xr, xi, yr, yi;
+
+	fft_band(width, index, count, &start, &end);
+	if (start == end)
+		return;
+
+	for (k = 0; k <= half / 2; k++) {
+		for (c = start; c < end; c += FFT_VECTOR) {
+			xr = *FFT_AT(fft->re, k, c, width);
+			xi = *FFT_AT(fft->im, k, c, width);
+			yr = *FFT_AT(fft->re, half - k, c, width);
+			yi = *FFT_AT(fft->im, half - k, c, width);
+
+			fft2_merge(&xr, &xi, &yr, &yi, fft->cos[k], fft->sin[k],
+				   FFT_AT(fft->re, k, c, width),
+				   FFT_AT(fft->im, k, c, width));
+
+			if (k > 0)
+				fft2_merge(&yr, &yi, &xr, &xi, fft->cos[half - k],
+					   fft->sin[half - k],
+					   FFT_AT(fft->re, half - k, c, width),
+					   FFT_AT(fft->im, half - k, c, width));
+		}
+	}
+
+	fft_batch(fft->columns, fft->re, fft->im, width, start, end, true);
+
+	for (k = 0; k < half; k++) {
+		memcpy(fft->field + (size_t)2 * k * width + start,
+		       fft->re + (size_t)k * width + start,
+		       (end - start) * sizeof(float));
+		memcpy(fft->field + (size_t)(2 * k + 1) * width + start,
+		       fft->im + (size_t)k * width + start,
+		       (end - start) * sizeof(float));
+	}
+}
+
+/*
+ * Computes the real field of a spectrum, overwriting the spectrum. The
+ * result is scaled by width * height / 2.
+ */
+void fft2_inverse(struct fft2 *fft, struct pool *pool, float *re, float *im,
+		  float *dst)
+{
+	fft->field = dst;
+	fft->spectrum_re = re;
+	fft->spectrum_im = im;
+
+	pool_run(pool, fft2_rows_inverse, fft);
+	pool_run(pool, fft2_columns_inverse, fft);
+}
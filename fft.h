@@ -0,0 +1,64 @@
+#ifndef FFT_H
+#define FFT_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "pool.h"
+
+/* number of transforms computed side by side in vector registers */
+#define FFT_VECTOR 8
+
+/*
+ * Plan for complex transforms of a power-of-two size, holding the bit
+ * reversal permutation and the twiddle factors.
+ */
+struct fft {
+	unsigned int size;
+	unsigned int log2;
+	unsigned int *reverse;
+	float *cos;
+	float *sin;
+};
+
+int fft_create(struct fft **fftp, unsigned int size);
+int fft_free(struct fft *fft);
+void fft_batch(const struct fft *fft, float *re, float *im, size_t stride,
+	       unsigned int start, unsigned int end, bool inverse);
+
+/*
+ * Plan for transforms of real width x height fields, both powers of two.
+ * The spectrum is stored transposed, with width rows of stride floats of
+ * which the first height / 2 + 1 are used, the others being redundant
+ * for real fields.
+ */
+struct fft2 {
+	unsigned int width;
+	unsigned int height;
+	unsigned int bins;
+	size_t stride;
+
+	/* half-size transforms down the columns, full-size along the rows */
+	struct fft *columns;
+	struct fft *rows;
+	float *cos;
+	float *sin;
+
+	/* half spectrum of the columns, bins rows of width floats */
+	float *re;
+	float *im;
+
+	float *field;
+	float *spectrum_re;
+	float *spectrum_im;
+};
+
+float *fft_alloc(size_t count);
+int fft2_create(struct fft2 **fftp, unsigned int width, unsigned int height);
+int fft2_free(struct fft2 *fft);
+void fft2_forward(struct fft2 *fft, struct pool *pool, const float *src,
+		  float *re, float *im);
+void fft2_inverse(struct fft2 *fft, struct pool *pool, float *re, float *im,
+		  float *dst);
+
+#endif /* FFT_H */
@@ -0,0 +1,521 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <linux/mempolicy.h>
+
+#include "grid.h"
+#include "lenia.h"
+#include "life.h"
+#include "margolus.h"
+#include "multistate.h"
+
+/*
+ * Split the rows of the grid into count bands and return the rows of band
+ * index. Band boundaries are multiples of align rows.
+ */
+void grid_band(struct grid *grid, unsigned int index, unsigned int count,
+	       unsigned int align, unsigned int *start, unsigned int *end)
+{
+	unsigned int rows = ALIGN(DIV_ROUND_UP(grid->height, count), align);
+
+	*start = index * rows;
+	*end = *start + rows;
+
+	if (*start > grid->height)
+		*start = grid->height;
+
+	if (*end > grid->height)
+		*end = grid->height;
+}
+
+#define HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+#define NUMA_MAX_NODES 1024
+#define NUMA_LONG_BITS (8 * sizeof(unsigned long))
+
+/*
+ * Returns the nodes the process may allocate memory from and the maxnode
+ * argument for mbind() that covers exactly those. mbind() rejects masks
+ * with bits set for nodes beyond what the kernel was built for, so a mask
+ * of all ones only works with the largest NODES_SHIFT.
+ */
+static int numa_get_allowed(unsigned long *nodes, unsigned long *maxnode)
+{
+	unsigned int i;
+
+	memset(nodes, 0, NUMA_MAX_NODES / 8);
+
+	if (syscall(SYS_get_mempolicy, NULL, nodes, NUMA_MAX_NODES + 1, NULL,
+		    MPOL_F_MEMS_ALLOWED) < 0)
+		return -errno;
+
+	for (i = NUMA_MAX_NODES; i > 0; i--) {
+		if (nodes[(i - 1) / NUMA_LONG_BITS] &
+		    (1ul << ((i - 1) % NUMA_LONG_BITS))) {
+			/* the kernel ignores the last bit of maxnode */
+			*maxnode = i + 1;
+			return 0;
+		}
+	}
+
+	return -ENODEV;
+}
+
+/*
+ * Bitmaps are allocated from huge pages if the system has any reserved and
+ * transparent huge pages are requested otherwise, since large grids would
+ * thrash the TLB with 4 KiB pages. A NUMA policy is applied before any of
+ * the pages are touched.
+ */
+void *grid_alloc(size_t size, enum numa_policy numa)
+{
+	unsigned long nodes[NUMA_MAX_NODES / NUMA_LONG_BITS], maxnode = 0;
+	void *ptr = MAP_FAILED;
+	int mode, err;
+
+	if (size >= HUGEPAGE_SIZE)
+		ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+	if (ptr == MAP_FAILED) {
+		ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (ptr == MAP_FAILED)
+			return NULL;
+
+		madvise(ptr, size, MADV_HUGEPAGE);
+	}
+
+	if (numa != NUMA_DEFAULT) {
+		if (numa == NUMA_INTERLEAVE) {
+			err = numa_get_allowed(nodes, &maxnode);
+			if (err < 0) {
+				fprintf(stderr, "failed to get NUMA nodes: %s\n",
+					strerror(-err));
+				return ptr;
+			}
+
+			mode = MPOL_INTERLEAVE;
+		} else {
+			mode = MPOL_LOCAL;
+		}
+
+		if (syscall(SYS_mbind, ptr, size, mode,
+			    mode == MPOL_LOCAL ? NULL : nodes, maxnode, 0) < 0)
+			fprintf(stderr, "failed to set NUMA policy: %m\n");
+	}
+
+	return ptr;
+}
+
+/*
+ * Touch the rows of each band from the thread that will later process it,
+ * so that with the default first-touch policy they are allocated on that
+ * thread's node.
+ */
+static void grid_touch_band(void *data, unsigned int index,
+			    unsigned int count)
+{
+	struct grid *grid = data;
+	unsigned int start, end, p;
+	size_t offset;
+
+	grid_band(grid, index, count, 1, &start, &end);
+
+	for (p = 0; p < grid->planes; p++) {
+		offset = p * grid->plane_size + grid_row_offset(grid, start);
+
+		memset(grid->parents + offset, 0, (end - start) * grid->pitch);
+		memset(grid->cells + offset, 0, (end - start) * grid->pitch);
+	}
+}
+
+/*
+ * In in-place mode only a single bitmap is allocated and each generation
+ * overwrites the previous one. This halves the memory needed for a given
+ * universe at the cost of four rows of scratch space per thread.
+ */
+struct grid *grid_new(unsigned int width, unsigned int height,
+		      unsigned int planes, struct pool *pool,
+		      enum numa_policy numa, bool in_place)
+{
+	/* rows are cache line aligned */
+	unsigned int pitch = ALIGN(DIV_ROUND_UP(width, 8), 64);
+	size_t plane_size = ALIGN((size_t)pitch * height, 4096);
+	size_t size = plane_size * planes;
+	struct grid *grid;
+
+	grid = calloc(1, sizeof(*grid));
+	if (!grid)
+		return NULL;
+
+	grid->width = width;
+	grid->pitch = pitch;
+	grid->height = height;
+	grid->scale = 1;
+	grid->planes = planes;
+	grid->plane_size = plane_size;
+	grid->pool = pool;
+
+	/* number of 64-bit words per row and valid bits in the last one */
+	grid->words = DIV_ROUND_UP(grid->width, 64);
+	grid->mask = ~0ull >> (grid->words * 64 - grid->width);
+
+	if (size >= HUGEPAGE_SIZE)
+		size = ALIGN(size, HUGEPAGE_SIZE);
+
+	grid->size = size;
+
+	grid->cells = grid_alloc(size, numa);
+	if (!grid->cells) {
+		free(grid);
+		return NULL;
+	}
+
+	if (in_place) {
+		grid->saved = calloc(4 * pool->count, pitch);
+		if (!grid->saved) {
+			munmap(grid->cells, size);
+			free(grid);
+			return NULL;
+		}
+
+		grid->parents = grid->cells;
+		grid->in_place = true;
+	} else {
+		grid->parents = grid_alloc(size, numa);
+		if (!grid->parents) {
+			munmap(grid->cells, size);
+			free(grid);
+			return NULL;
+		}
+	}
+
+	pool_run(pool, grid_touch_band, grid);
+
+	return grid;
+}
+
+void grid_free(struct grid *grid)
+{
+	if (grid) {
+		if (!grid->in_place)
+			munmap(grid->parents, grid->size);
+
+		munmap(grid->cells, grid->size);
+		free(grid->dirty);
+		if (grid->multistate)
+			multistate_free(grid->multistate);
+
+		if (grid->margolus)
+			margolus_free(grid->margolus);
+
+		free(grid->saved);
+		free(grid->palette);
+		free(grid->rows);
+	}
+
+	free(grid);
+}
+
+/*
+ * Load word i of a row along with the same word shifted such that each bit
+ * holds its west or east neighbour, wrapping around at the edges.
+ */
+static inline void grid_load(struct grid *grid, const uint64_t *row,
+			     unsigned int i, uint64_t *west, uint64_t *center,
+			     uint64_t *east)
+{
+	unsigned int last = grid->words - 1, msb = (grid->width - 1) % 64;
+	uint64_t word = grid_word(grid, row, i);
+
+	*center = word;
+	*west = word << 1;
+	*east = word >> 1;
+
+	if (i > 0)
+		*west |= grid_word(grid, row, i - 1) >> 63;
+	else
+		*west |= (grid_word(grid, row, last) >> msb) & 1;
+
+	if (i < last)
+		*east |= grid_word(grid, row, i + 1) << 63;
+	else
+		*east |= (grid_word(grid, row, 0) & 1) << msb;
+}
+
+/*
+ * Rules other than Conway's Life are evaluated by running the circuit of
+ * the rule for RULE_WORDS words of the row at a time.
+ */
+static bool grid_tick_row_rule(struct grid *grid, const void *above,
+			       const void *row, const void *below, void *out)
+{
+	uint64_t inputs[RULE_NUM_INPUTS][RULE_WORDS] = { { 0 } };
+	uint64_t *dst = out, next[RULE_WORDS], changed = 0;
+	unsigned int i, j, batch;
+
+	for (i = 0; i < grid->words; i += RULE_WORDS) {
+		batch = grid->words - i;
+		if (batch > RULE_WORDS)
+			batch = RULE_WORDS;
+
+		for (j = 0; j < batch; j++) {
+			uint64_t nw, n, ne, w, c, e, sw, s, se;
+
+			grid_load(grid, above, i + j, &nw, &n, &ne);
+			grid_load(grid, row, i + j, &w, &c, &e);
+			grid_load(grid, below, i + j, &sw, &s, &se);
+
+			rule_load(grid->rule, inputs, j, nw, n, ne, w, c, e,
+				  sw, s, se);
+		}
+
+		rule_eval(grid->rule, inputs, next);
+
+		for (j = 0; j < batch; j++) {
+			if (i + j == grid->words - 1)
+				next[j] &= grid->mask;
+
+			changed |= le64toh(dst[i + j]) ^ next[j];
+			dst[i + j] = htole64(next[j]);
+		}
+	}
+
+	return changed != 0;
+}
+
+/*
+ * Compute one row of the next generation from the three rows around it, 64
+ * cells at a time. Returns true if the new row differs from the previous
+ * contents of out.
+ */
+bool grid_tick_row(struct grid *grid, const void *above, const void *row,
+		   const void *below, void *out)
+{
+	uint64_t *dst = out, changed = 0;
+	unsigned int i;
+
+	if (grid->rule)
+		return grid_tick_row_rule(grid, above, row, below, out);
+
+	for (i = 0; i < grid->words; i++) {
+		uint64_t nw, n, ne, w, c, e, sw, s, se;
+		uint64_t next;
+
+		grid_load(grid, above, i, &nw, &n, &ne);
+		grid_load(grid, row, i, &w, &c, &e);
+		grid_load(grid, below, i, &sw, &s, &se);
+
+		next = life_next(nw, n, ne, w, c, e, sw, s, se);
+
+		if (i == grid->words - 1)
+			next &= grid->mask;
+
+		changed |= le64toh(dst[i]) ^ next;
+		dst[i] = htole64(next);
+	}
+
+	return changed != 0;
+}
+
+bool grid_tick_line(struct grid *grid, unsigned int y)
+{
+	unsigned int above = wrap((int)y - 1, grid->height);
+	unsigned int below = wrap(y + 1, grid->height);
+
+	return grid_tick_row(grid, grid->parents + grid_row_offset(grid, above),
+		      grid->parents + grid_row_offset(grid, y),
+		      grid->parents + grid_row_offset(grid, below),
+		      grid->cells + grid_row_offset(grid, y));
+}
+
+static void grid_tick_band(void *data, unsigned int index, unsigned int count)
+{
+	struct grid *grid = data;
+	unsigned int start, end, y;
+
+	grid_band(grid, index, count, 1, &start, &end);
+
+	for (y = start; y < end; y++) {
+		unsigned int offset = grid_row_offset(grid, y);
+
+		grid_tick_line(grid, y);
+
+		if (grid->dirty)
+			grid->dirty[y] = memcmp(grid->cells + offset,
+						grid->parents + offset,
+						grid->pitch) != 0;
+	}
+}
+
+static inline void *grid_saved_row(struct grid *grid, unsigned int index,
+				   unsigned int row)
+{
+	return grid->saved + (index * 4 + row) * grid->pitch;
+}
+
+/*
+ * Rows 0 and 1 of the scratch space of each band hold copies of the rows
+ * just above and below it. They are taken before any band starts to
+ * overwrite its rows, so that the boundary rows can be computed from the
+ * original contents of the neighbouring bands.
+ */
+static void grid_save_band(void *data, unsigned int index, unsigned int count)
+{
+	struct grid *grid = data;
+	unsigned int start, end;
+
+	grid_band(grid, index, count, 1, &start, &end);
+
+	if (start == end)
+		return;
+
+	memcpy(grid_saved_row(grid, index, 0), grid->cells +
+	       grid_row_offset(grid, wrap((int)start - 1, grid->height)),
+	       grid->pitch);
+	memcpy(grid_saved_row(grid, index, 1), grid->cells +
+	       grid_row_offset(grid, wrap(end, grid->height)), grid->pitch);
+}
+
+/*
+ * Rows 2 and 3 of the scratch space are a rolling window holding the
+ * original contents of the row being overwritten and the one above it.
+ * The row below is always still original, except for the last row of the
+ * band where the saved copy is used.
+ */
+static void grid_tick_band_in_place(void *data, unsigned int index,
+				    unsigned int count)
+{
+	struct grid *grid = data;
+	unsigned int start, end, y;
+	const void *above, *below;
+	void *row, *copy;
+
+	grid_band(grid, index, count, 1, &start, &end);
+
+	above = grid_saved_row(grid, index, 0);
+
+	for (y = start; y < end; y++) {
+		row = grid->cells + grid_row_offset(grid, y);
+		copy = grid_saved_row(grid, index, 2 + (y & 1));
+
+		if (y + 1 < end)
+			below = row + grid->pitch;
+		else
+			below = grid_saved_row(grid, index, 1);
+
+		memcpy(copy, row, grid->pitch);
+		grid_tick_row(grid, above, copy, below, row);
+		above = copy;
+	}
+}
+
+void grid_tick(struct grid *grid)
+{
+	if (grid->margolus) {
+		margolus_tick(grid->margolus, grid->pool, grid->parents,
+			      grid->cells, false);
+	} else if (grid->multistate) {
+		multistate_tick(grid->multistate, grid->pool, grid->parents,
+				grid->cells);
+	} else if (grid->in_place) {
+		pool_run(grid->pool, grid_save_band, grid);
+		pool_run(grid->pool, grid_tick_band_in_place, grid);
+	} else {
+		pool_run(grid->pool, grid_tick_band, grid);
+	}
+}
+
+/* count the cells of the current generation that are not dead */
+unsigned long grid_population(struct grid *grid)
+{
+	unsigned long population = 0;
+	unsigned int i, p, y;
+	uint64_t word;
+
+	if (grid->lenia)
+		return lenia_population(grid->lenia);
+
+	for (y = 0; y < grid->height; y++) {
+		uint64_t *row = grid->parents + grid_row_offset(grid, y);
+
+		for (i = 0; i < grid->words; i++) {
+			word = grid_word(grid, row, i);
+
+			for (p = 1; p < grid->planes; p++)
+				word |= grid_word(grid, (void *)row +
+						  p * grid->plane_size, i);
+
+			population += __builtin_popcountll(word);
+		}
+	}
+
+	return population;
+}
+
+void grid_swap(struct grid *grid)
+{
+	void *tmp = grid->parents;
+	grid->parents = grid->cells;
+	grid->cells = tmp;
+}
+
+void grid_add_cell(struct grid *grid, unsigned int x, unsigned int y)
+{
+	uint8_t *p = grid->parents + grid_offset(grid, x, y);
+
+	*p |= BIT(x % 8);
+}
+
+void grid_set_state(struct grid *grid, unsigned int x, unsigned int y,
+		    unsigned int state)
+{
+	uint8_t *p = grid->parents + grid_offset(grid, x, y);
+	unsigned int i;
+
+	for (i = 0; i < grid->planes; i++, p += grid->plane_size) {
+		if (state & BIT(i))
+			*p |= BIT(x % 8);
+		else
+			*p &= ~BIT(x % 8);
+	}
+}
+
+void grid_randomize_area(struct grid *grid, unsigned int x0, unsigned int y0,
+			 unsigned int width, unsigned int height,
+			 unsigned int seed)
+{
+	unsigned int x, y;
+
+	for (y = y0; y < y0 + height; y++) {
+		for (x = x0; x < x0 + width; x++) {
+			bool alive = rand_r(&seed) > RAND_MAX / 2;
+			if (alive)
+				grid_add_cell(grid, x, y);
+		}
+	}
+}
+
+void grid_randomize(struct grid *grid, unsigned int seed)
+{
+	grid_randomize_area(grid, 0, 0, grid->width, grid->height, seed);
+}
+
+unsigned int grid_get_state(struct grid *grid, unsigned int x, unsigned int y)
+{
+	const uint8_t *p = grid->parents + grid_offset(grid, x, y);
+	unsigned int i, state = 0;
+
+	for (i = 0; i < grid->planes; i++, p += grid->plane_size)
+		state |= ((*p >> (x % 8)) & 1) << i;
+
+	return state;
+}
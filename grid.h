@@ -0,0 +1,139 @@
+#ifndef GRID_H
+#define GRID_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <endian.h>
+
+#include "pool.h"
+#include "rule.h"
+
+#define ALIGN_MASK(x, mask) (((x) + (mask)) & ~(mask))
+#define ALIGN(x, a) ALIGN_MASK(x, (typeof(x))(a) - 1)
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+#define BIT(x) (1 << (x))
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+enum numa_policy {
+	NUMA_DEFAULT,
+	NUMA_LOCAL,
+	NUMA_INTERLEAVE,
+};
+
+/*
+ * Two-state universe on a torus, one bit per cell in rows of 64-bit words
+ * (least significant bit first), along with the state of the engines that
+ * run other kinds of rules on the same bitmaps. The colours, the scale and
+ * the scratch rows are used by whoever draws the grid.
+ */
+struct grid {
+	unsigned int width;
+	unsigned int pitch;
+	unsigned int height;
+	unsigned int scale;
+	/* pixel position of the top left cell, to centre smaller universes */
+	unsigned int left;
+	unsigned int top;
+
+	unsigned int words;
+	uint64_t mask;
+
+	uint32_t alive;
+	uint32_t dead;
+
+	void (*draw_row)(struct grid *grid, const uint8_t *cells,
+			 uint32_t *ptr);
+	uint32_t *rows;
+
+	struct pool *pool;
+
+	/* rule to run, Conway's Life if NULL */
+	const struct rule *rule;
+
+	void *parents;
+	void *cells;
+	size_t size;
+
+	/*
+	 * Multi-state universes have further bit planes after the first one,
+	 * plane_size bytes apart, and are drawn through the palette.
+	 */
+	unsigned int planes;
+	size_t plane_size;
+	uint32_t *palette;
+	struct multistate *multistate;
+
+	/* block rule on the Margolus neighbourhood, if any */
+	struct margolus *margolus;
+
+	/* continuous universe that is drawn instead of the cells, if any */
+	struct lenia *lenia;
+
+	bool in_place;
+	void *saved;
+
+	/* rows that changed in the last tick, only tracked for the history */
+	uint8_t *dirty;
+};
+
+static inline unsigned int wrap(int i, unsigned int max)
+{
+	if (i < 0)
+		return i + max;
+
+	if (i >= max)
+		return i - max;
+
+	return i;
+}
+
+static inline size_t grid_offset(struct grid *grid, unsigned int x,
+				 unsigned int y)
+{
+	return (size_t)y * grid->pitch + (x / 8);
+}
+
+static inline size_t grid_row_offset(struct grid *grid, unsigned int y)
+{
+	return (size_t)y * grid->pitch;
+}
+
+static inline uint64_t grid_word(struct grid *grid, const uint64_t *row,
+				  unsigned int i)
+{
+	uint64_t word = le64toh(row[i]);
+
+	if (i == grid->words - 1)
+		word &= grid->mask;
+
+	return word;
+}
+
+void *grid_alloc(size_t size, enum numa_policy numa);
+struct grid *grid_new(unsigned int width, unsigned int height,
+		      unsigned int planes, struct pool *pool,
+		      enum numa_policy numa, bool in_place);
+void grid_free(struct grid *grid);
+void grid_band(struct grid *grid, unsigned int index, unsigned int count,
+	       unsigned int align, unsigned int *start, unsigned int *end);
+
+bool grid_tick_row(struct grid *grid, const void *above, const void *row,
+		   const void *below, void *out);
+bool grid_tick_line(struct grid *grid, unsigned int y);
+void grid_tick(struct grid *grid);
+void grid_swap(struct grid *grid);
+unsigned long grid_population(struct grid *grid);
+
+void grid_add_cell(struct grid *grid, unsigned int x, unsigned int y);
+void grid_set_state(struct grid *grid, unsigned int x, unsigned int y,
+		    unsigned int state);
+unsigned int grid_get_state(struct grid *grid, unsigned int x,
+			    unsigned int y);
+void grid_randomize_area(struct grid *grid, unsigned int x0, unsigned int y0,
+			 unsigned int width, unsigned int height,
+			 unsigned int seed);
+void grid_randomize(struct grid *grid, unsigned int seed);
+
+#endif /* GRID_H */
@@ -0,0 +1,347 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "history.h"
+
+/* largest encoding of a frame: every other word non-zero */
+static size_t history_worst_case(unsigned int words, unsigned int height)
+{
+	return (size_t)height * (words + (words + 1) / 2);
+}
+
+int history_create(struct history **historyp, unsigned int pitch,
+		   unsigned int height, unsigned int interval, size_t budget)
+{
+	struct history *history;
+	size_t worst;
+
+	if (!pitch || pitch % sizeof(uint64_t) || !height || !interval)
+		return -EINVAL;
+
+	worst = history_worst_case(pitch / sizeof(uint64_t), height);
+
+	/* the budget must at least hold any single entry */
+	if (budget / sizeof(uint64_t) < worst)
+		return -ENOSPC;
+
+	history = calloc(1, sizeof(*history));
+	if (!history)
+		return -ENOMEM;
+
+	history->words = pitch / sizeof(uint64_t);
+	history->height = height;
+	history->interval = interval;
+	history->capacity = budget / sizeof(uint64_t);
+	history->size = 64;
+
+	history->data = malloc(history->capacity * sizeof(uint64_t));
+	history->scratch = malloc(worst * sizeof(uint64_t));
+	history->entries = calloc(history->size, sizeof(*history->entries));
+
+	if (!history->data || !history->scratch || !history->entries) {
+		history_free(history);
+		return -ENOMEM;
+	}
+
+	*historyp = history;
+
+	return 0;
+}
+
+int history_free(struct history *history)
+{
+	if (!history)
+		return -EINVAL;
+
+	free(history->entries);
+	free(history->scratch);
+	free(history->data);
+	free(history);
+
+	return 0;
+}
+
+/*
+ * Encodes the runs of non-zero words of cells, or of cells XOR previous,
+ * into the scratch buffer. Only the rows marked in dirty are looked at, so
+ * the cost of recording a delta depends on the number of changed rows.
+ */
+static size_t history_encode(struct history *history, const uint64_t *cells,
+			     const uint64_t *previous, const uint8_t *dirty)
+{
+	unsigned int words = history->words, start, i, y;
+	uint64_t *out = history->scratch;
+	size_t count = 0, offset;
+	uint64_t word;
+
+	for (y = 0; y < history->height; y++) {
+		if (dirty && !dirty[y])
+			continue;
+
+		offset = (size_t)y * words;
+
+		for (i = 0; i < words; ) {
+			word = cells[offset + i];
+			if (previous)
+				word ^= previous[offset + i];
+
+			if (!word) {
+				i++;
+				continue;
+			}
+
+			start = i;
+
+			while (i < words && word) {
+				out[count + 1 + i - start] = word;
+
+				if (++i < words) {
+					word = cells[offset + i];
+					if (previous)
+						word ^= previous[offset + i];
+				}
+			}
+
+			out[count] = (offset + start) << 32 | (i - start);
+			count += 1 + i - start;
+		}
+	}
+
+	return count;
+}
+
+static void history_apply(struct history *history,
+			  const struct history_entry *entry, uint64_t *cells)
+{
+	const uint64_t *data = history->data + entry->offset;
+	size_t count = 0, offset, length, i;
+
+	if (entry->keyframe)
+		memset(cells, 0, (size_t)history->words * history->height *
+		       sizeof(uint64_t));
+
+	while (count < entry->count) {
+		offset = data[count] >> 32;
+		length = data[count] & 0xffffffff;
+
+		for (i = 0; i < length; i++)
+			cells[offset + i] ^= data[count + 1 + i];
+
+		count += 1 + length;
+	}
+}
+
+static void history_evict(struct history *history)
+{
+	do {
+		history->first = (history->first + 1) % history->size;
+		history->count--;
+	} while (history->count && !history_entry(history, 0)->keyframe);
+
+	if (!history->count)
+		history->head = 0;
+}
+
+/*
+ * Finds room for count words after the newest entry, wrapping around to
+ * the start of the buffer if necessary, and evicts the oldest entries
+ * until the room is free.
+ */
+static size_t history_alloc(struct history *history, size_t count)
+{
+	size_t head, tail;
+
+	while (history->count) {
+		tail = history_entry(history, 0)->offset;
+		head = history->head;
+
+		if (head + count > history->capacity)
+			head = 0;
+
+		if (tail >= history->head) {
+			/* live entries wrap around the end of the buffer */
+			if (head == 0 || head + count > tail) {
+				history_evict(history);
+				continue;
+			}
+		} else if (head == 0 && count > tail) {
+			history_evict(history);
+			continue;
+		}
+
+		return head;
+	}
+
+	return 0;
+}
+
+static int history_grow(struct history *history)
+{
+	struct history_entry *entries;
+	unsigned int i;
+
+	entries = calloc(history->size * 2, sizeof(*entries));
+	if (!entries)
+		return -ENOMEM;
+
+	for (i = 0; i < history->count; i++)
+		entries[i] = *history_entry(history, i);
+
+	free(history->entries);
+	history->entries = entries;
+	history->size *= 2;
+	history->first = 0;
+
+	return 0;
+}
+
+/* drops the given generation and all newer ones */
+static void history_drop(struct history *history, unsigned int generation)
+{
+	struct history_entry *entry;
+
+	while (history->count && history_newest(history) >= generation)
+		history->count--;
+
+	if (history->count) {
+		entry = history_entry(history, history->count - 1);
+		history->head = entry->offset + entry->count;
+	} else {
+		history->head = 0;
+	}
+}
+
+/*
+ * Records a generation. If the previous generation is given and is the
+ * newest one in the history, only the difference to it is stored, except
+ * every interval generations where a keyframe is stored instead. Newer
+ * generations are dropped first, so recording after seeking back starts a
+ * new timeline.
+ */
+int history_record(struct history *history, unsigned int generation,
+		   const void *cells, const void *previous,
+		   const uint8_t *dirty)
+{
+	struct history_entry *entry;
+	size_t count, offset;
+	bool keyframe;
+	int err;
+
+	history_drop(history, generation);
+
+	keyframe = !previous || !history->count ||
+		   generation % history->interval == 0 ||
+		   history_newest(history) != generation - 1;
+
+	for (;;) {
+		count = history_encode(history, cells,
+				       keyframe ? NULL : previous,
+				       keyframe ? NULL : dirty);
+		offset = history_alloc(history, count);
+
+		if (keyframe || history->count)
+			break;
+
+		/* evictions left the delta without a keyframe to apply to */
+		keyframe = true;
+	}
+
+	if (history->count == history->size) {
+		err = history_grow(history);
+		if (err < 0)
+			return err;
+	}
+
+	memcpy(history->data + offset, history->scratch,
+	       count * sizeof(uint64_t));
+
+	entry = history_entry(history, history->count++);
+	entry->generation = generation;
+	entry->keyframe = keyframe;
+	entry->offset = offset;
+	entry->count = count;
+
+	history->head = offset + count;
+	history->position = generation;
+	history->valid = true;
+
+	return 0;
+}
+
+static int history_find(struct history *history, unsigned int generation)
+{
+	unsigned int low = 0, high = history->count, middle;
+
+	while (low < high) {
+		middle = (low + high) / 2;
+
+		if (history_entry(history, middle)->generation < generation)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	if (low < history->count &&
+	    history_entry(history, low)->generation == generation)
+		return low;
+
+	return -1;
+}
+
+/* deltas can be applied in either direction, keyframes can not */
+static bool history_walkable(struct history *history, int from, int to)
+{
+	int i, low = from < to ? from : to, high = from < to ? to : from;
+
+	for (i = low + 1; i <= high; i++)
+		if (history_entry(history, i)->keyframe)
+			return false;
+
+	return true;
+}
+
+/*
+ * Restores a retained generation into cells. If cells still holds the
+ * generation that was last recorded or sought to, and the deltas between
+ * the two are fewer than the ones after the nearest keyframe, the deltas
+ * are applied directly, which makes stepping back and forth cheap.
+ */
+int history_seek(struct history *history, unsigned int generation,
+		 void *cells)
+{
+	int index, key, from = -1, i;
+
+	index = history_find(history, generation);
+	if (index < 0)
+		return -ENOENT;
+
+	for (key = index; !history_entry(history, key)->keyframe; key--)
+		;
+
+	if (history->valid)
+		from = history_find(history, history->position);
+
+	if (from >= 0 && abs(from - index) <= index - key &&
+	    history_walkable(history, from, index)) {
+		for (i = from; i > index; i--)
+			history_apply(history, history_entry(history, i), cells);
+
+		for (i = from + 1; i <= index; i++)
+			history_apply(history, history_entry(history, i), cells);
+	} else {
+		for (i = key; i <= index; i++)
+			history_apply(history, history_entry(history, i), cells);
+	}
+
+	history->position = generation;
+	history->valid = true;
+
+	return 0;
+}
+
+/* drops all generations newer than the given one */
+void history_truncate(struct history *history, unsigned int generation)
+{
+	history_drop(history, generation + 1);
+}
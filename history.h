@@ -0,0 +1,73 @@
+#ifndef HISTORY_H
+#define HISTORY_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Each recorded generation is stored either as a keyframe or as the XOR
+ * of itself and the previous generation. Both are stored as runs of
+ * non-zero words, each run preceded by a header word holding the offset
+ * of the run in the upper and its length in the lower 32 bits.
+ */
+struct history_entry {
+	unsigned int generation;
+	bool keyframe;
+	size_t offset;
+	size_t count;
+};
+
+/*
+ * Ring of recorded generations with a fixed memory budget. The oldest
+ * entries are evicted when the budget is exhausted, and the oldest entry
+ * is always a keyframe.
+ */
+struct history {
+	unsigned int words;
+	unsigned int height;
+	unsigned int interval;
+
+	uint64_t *data;
+	size_t capacity;
+	size_t head;
+
+	struct history_entry *entries;
+	unsigned int size;
+	unsigned int first;
+	unsigned int count;
+
+	uint64_t *scratch;
+
+	/* generation held by the caller's buffer, if valid */
+	unsigned int position;
+	bool valid;
+};
+
+int history_create(struct history **historyp, unsigned int pitch,
+		   unsigned int height, unsigned int interval, size_t budget);
+int history_free(struct history *history);
+int history_record(struct history *history, unsigned int generation,
+		   const void *cells, const void *previous,
+		   const uint8_t *dirty);
+int history_seek(struct history *history, unsigned int generation,
+		 void *cells);
+void history_truncate(struct history *history, unsigned int generation);
+
+static inline struct history_entry *history_entry(struct history *history,
+						  unsigned int index)
+{
+	return &history->entries[(history->first + index) % history->size];
+}
+
+static inline unsigned int history_oldest(struct history *history)
+{
+	return history_entry(history, 0)->generation;
+}
+
+static inline unsigned int history_newest(struct history *history)
+{
+	return history_entry(history, history->count - 1)->generation;
+}
+
+#endif /* HISTORY_H */
@@ -0,0 +1,249 @@
+#include <errno.h>
+#include <stdio.h>
+
+#include "hud.h"
+
+#define HUD_WIDTH 128
+#define HUD_HEIGHT 70
+#define HUD_MARGIN 8
+#define HUD_SCALE 2
+
+#define HUD_FOREGROUND 0xffffffff
+#define HUD_BACKGROUND 0xc0000000
+
+/*
+ * 3x5 pixel glyphs, one row per three bits with the most significant bit
+ * at the left. Each glyph occupies a 4x6 cell including spacing.
+ */
+#define GLYPH(a, b, c, d, e) \
+	(((a) << 12) | ((b) << 9) | ((c) << 6) | ((d) << 3) | (e))
+
+#define GLYPH_WIDTH 4
+#define GLYPH_HEIGHT 6
+
+static const uint16_t font[128] = {
+	['0'] = GLYPH(7, 5, 5, 5, 7),
+	['1'] = GLYPH(2, 6, 2, 2, 7),
+	['2'] = GLYPH(7, 1, 7, 4, 7),
+	['3'] = GLYPH(7, 1, 3, 1, 7),
+	['4'] = GLYPH(5, 5, 7, 1, 1),
+	['5'] = GLYPH(7, 4, 7, 1, 7),
+	['6'] = GLYPH(7, 4, 7, 5, 7),
+	['7'] = GLYPH(7, 1, 1, 2, 2),
+	['8'] = GLYPH(7, 5, 7, 5, 7),
+	['9'] = GLYPH(7, 5, 7, 1, 7),
+	['A'] = GLYPH(2, 5, 7, 5, 5),
+	['B'] = GLYPH(6, 5, 6, 5, 6),
+	['C'] = GLYPH(3, 4, 4, 4, 3),
+	['D'] = GLYPH(6, 5, 5, 5, 6),
+	['E'] = GLYPH(7, 4, 6, 4, 7),
+	['F'] = GLYPH(7, 4, 6, 4, 4),
+	['G'] = GLYPH(3, 4, 5, 5, 3),
+	['H'] = GLYPH(5, 5, 7, 5, 5),
+	['I'] = GLYPH(7, 2, 2, 2, 7),
+	['J'] = GLYPH(1, 1, 1, 5, 2),
+	['K'] = GLYPH(5, 5, 6, 5, 5),
+	['L'] = GLYPH(4, 4, 4, 4, 7),
+	['M'] = GLYPH(5, 7, 7, 5, 5),
+	['N'] = GLYPH(6, 5, 5, 5, 5),
+	['O'] = GLYPH(2, 5, 5, 5, 2),
+	['P'] = GLYPH(6, 5, 6, 4, 4),
+	['Q'] = GLYPH(2, 5, 5, 6, 3),
+	['R'] = GLYPH(6, 5, 6, 5, 5),
+	['S'] = GLYPH(3, 4, 2, 1, 6),
+	['T'] = GLYPH(7, 2, 2, 2, 2),
+	['U'] = GLYPH(5, 5, 5, 5, 7),
+	['V'] = GLYPH(5, 5, 5, 5, 2),
+	['W'] = GLYPH(5, 5, 7, 7, 5),
+	['X'] = GLYPH(5, 5, 2, 5, 5),
+	['Y'] = GLYPH(5, 5, 2, 2, 2),
+	['Z'] = GLYPH(7, 1, 2, 4, 7),
+	[':'] = GLYPH(0, 2, 0, 2, 0),
+	['.'] = GLYPH(0, 0, 0, 0, 2),
+	['/'] = GLYPH(1, 1, 2, 4, 4),
+	['-'] = GLYPH(0, 0, 7, 0, 0),
+	['%'] = GLYPH(5, 1, 2, 4, 5),
+};
+
+static void hud_draw_char(struct hud *hud, unsigned int x, unsigned int y,
+			  char c)
+{
+	unsigned int i, j, k, l;
+	uint32_t *pixel;
+	uint16_t glyph;
+
+	if (c >= 'a' && c <= 'z')
+		c -= 'a' - 'A';
+
+	glyph = font[c & 0x7f];
+
+	for (j = 0; j < 5; j++) {
+		for (i = 0; i < 3; i++) {
+			if (!(glyph & (1 << ((4 - j) * 3 + (2 - i)))))
+				continue;
+
+			pixel = hud->pixels + (y + j * HUD_SCALE) * hud->pitch +
+				x + i * HUD_SCALE;
+
+			for (l = 0; l < HUD_SCALE; l++)
+				for (k = 0; k < HUD_SCALE; k++)
+					pixel[l * hud->pitch + k] =
+						HUD_FOREGROUND;
+		}
+	}
+}
+
+static void hud_draw_text(struct hud *hud, unsigned int line, const char *text)
+{
+	unsigned int x = HUD_SCALE * 2, y;
+
+	y = HUD_SCALE * (2 + line * (GLYPH_HEIGHT + 1));
+
+	while (*text && x + GLYPH_WIDTH * HUD_SCALE <= hud->width) {
+		hud_draw_char(hud, x, y, *text++);
+		x += GLYPH_WIDTH * HUD_SCALE;
+	}
+}
+
+/*
+ * The HUD is rendered into an overlay plane if the CRTC has a spare one so
+ * that the display engine composites it and the primary framebuffer never
+ * needs to be touched. Otherwise it is rendered into a private buffer that
+ * is copied over the framebuffer after every frame.
+ */
+int hud_create(struct hud **hudp, struct screen *screen)
+{
+	struct hud *hud;
+	void *ptr;
+	int err;
+
+	hud = calloc(1, sizeof(*hud));
+	if (!hud)
+		return -ENOMEM;
+
+	hud->screen = screen;
+	hud->width = HUD_WIDTH;
+	hud->height = HUD_HEIGHT;
+
+	err = plane_create(&hud->plane, screen, hud->width, hud->height,
+			   DRM_FORMAT_ARGB8888);
+	if (err == 0) {
+		err = surface_lock(hud->plane->fb, &ptr);
+		if (err == 0) {
+			hud->pixels = ptr;
+			hud->pitch = hud->plane->fb->bo->pitch / 4;
+			surface_unlock(hud->plane->fb);
+
+			err = plane_show(hud->plane, HUD_MARGIN, HUD_MARGIN);
+		}
+
+		if (err < 0) {
+			plane_free(hud->plane);
+			hud->plane = NULL;
+		}
+	}
+
+	if (!hud->plane) {
+		fprintf(stderr, "no overlay plane available (%s), using "
+			"software HUD\n", strerror(-err));
+
+		hud->pitch = hud->width;
+		hud->pixels = calloc(hud->pitch * hud->height, 4);
+		if (!hud->pixels) {
+			free(hud);
+			return -ENOMEM;
+		}
+	}
+
+	*hudp = hud;
+
+	return 0;
+}
+
+int hud_free(struct hud *hud)
+{
+	if (!hud)
+		return -EINVAL;
+
+	if (hud->plane)
+		plane_free(hud->plane);
+	else
+		free(hud->pixels);
+
+	free(hud);
+
+	return 0;
+}
+
+int hud_update(struct hud *hud, const struct hud_stats *stats)
+{
+	unsigned int x, y;
+	char text[32];
+
+	if (!hud || !stats)
+		return -EINVAL;
+
+	for (y = 0; y < hud->height; y++)
+		for (x = 0; x < hud->width; x++)
+			hud->pixels[y * hud->pitch + x] = HUD_BACKGROUND;
+
+	snprintf(text, sizeof(text), "GEN %lu", stats->generation);
+	hud_draw_text(hud, 0, text);
+
+	snprintf(text, sizeof(text), "POP %lu", stats->population);
+	hud_draw_text(hud, 1, text);
+
+	snprintf(text, sizeof(text), "GEN/S %.1f", stats->rate);
+	hud_draw_text(hud, 2, text);
+
+	snprintf(text, sizeof(text), "FPS %.1f", stats->fps);
+	hud_draw_text(hud, 3, text);
+
+	snprintf(text, sizeof(text), "FRAME %.2fMS", stats->frame_time);
+	hud_draw_text(hud, 4, text);
+
+	return 0;
+}
+
+/*
+ * Copy the software HUD into the framebuffer, clipped to its size. This is
+ * a no-op when the HUD lives on an overlay plane.
+ */
+int hud_blit(struct hud *hud, struct surface *fb)
+{
+	unsigned int width, height, y;
+	void *ptr;
+	int err;
+
+	if (!hud || !fb)
+		return -EINVAL;
+
+	if (hud->plane)
+		return 0;
+
+	if (fb->width <= HUD_MARGIN || fb->height <= HUD_MARGIN)
+		return 0;
+
+	width = fb->width - HUD_MARGIN;
+	if (width > hud->width)
+		width = hud->width;
+
+	height = fb->height - HUD_MARGIN;
+	if (height > hud->height)
+		height = hud->height;
+
+	err = surface_lock(fb, &ptr);
+	if (err < 0)
+		return err;
+
+	for (y = 0; y < height; y++) {
+		uint32_t *dst = ptr + (HUD_MARGIN + y) * fb->bo->pitch;
+
+		memcpy(dst + HUD_MARGIN, hud->pixels + y * hud->pitch,
+		       width * 4);
+	}
+
+	surface_unlock(fb);
+
+	return 0;
+}
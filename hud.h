@@ -0,0 +1,29 @@
+#ifndef HUD_H
+#define HUD_H 1
+
+#include "drm-utils.h"
+
+struct hud_stats {
+	unsigned long generation;
+	unsigned long population;
+	/* generations stepped and frames drawn per second */
+	double rate;
+	double fps;
+	double frame_time;
+};
+
+struct hud {
+	struct screen *screen;
+	struct plane *plane;
+	unsigned int width;
+	unsigned int height;
+	unsigned int pitch;
+	uint32_t *pixels;
+};
+
+int hud_create(struct hud **hudp, struct screen *screen);
+int hud_free(struct hud *hud);
+int hud_update(struct hud *hud, const struct hud_stats *stats);
+int hud_blit(struct hud *hud, struct surface *fb);
+
+#endif /* HUD_H */
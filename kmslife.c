@@ -1,209 +1,466 @@
+#define _GNU_SOURCE
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <limits.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <termios.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <sys/mman.h>
+
+#include "census.h"
 #include "drm-utils.h"
+#include "elementary.h"
+#include "ensemble.h"
+#include "grid.h"
+#include "history.h"
+#include "hud.h"
+#include "lease.h"
+#include "lenia.h"
+#include "ltl.h"
+#include "margolus.h"
+#include "multistate.h"
+#include "pool.h"
+#include "rule.h"
+#include "shard.h"
+#include "tile.h"
 
 static const char DEFAULT_DEVICE[] = "/dev/dri/card0";
+static const unsigned int DEFAULT_KEYFRAMES = 64;
+
+/*
+ * Expand one row of cells into one row of pixels. Specialised variants are
+ * generated for the common scales so that the stores for each cell unroll
+ * into a fixed number of constant-width writes, any other scale uses the
+ * generic variant.
+ */
+#define GRID_DRAW_ROW(name, n)						\
+static void name(struct grid *grid, const uint8_t *cells, uint32_t *ptr)	\
+{									\
+	const uint32_t colors[2] = { grid->dead, grid->alive };		\
+	const unsigned int scale = (n);					\
+	unsigned int x, i;						\
+									\
+	for (x = 0; x < grid->width; x++, ptr += scale) {		\
+		uint32_t color = colors[(cells[x / 8] >> (x % 8)) & 1];	\
+									\
+		for (i = 0; i < scale; i++)				\
+			ptr[i] = color;					\
+	}								\
+}
 
-struct grid {
-	unsigned int width;
-	unsigned int pitch;
-	unsigned int height;
-	unsigned int scale;
-
-	void *parents;
-	void *cells;
-};
-
-#define ALIGN_MASK(x, mask) (((x) + (mask)) & ~(mask))
-#define ALIGN(x, a) ALIGN_MASK(x, (typeof(x))(a) - 1)
-#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
-#define BIT(x) (1 << (x))
+GRID_DRAW_ROW(grid_draw_row_1, 1)
+GRID_DRAW_ROW(grid_draw_row_2, 2)
+GRID_DRAW_ROW(grid_draw_row_3, 3)
+GRID_DRAW_ROW(grid_draw_row_4, 4)
+GRID_DRAW_ROW(grid_draw_row_8, 8)
+GRID_DRAW_ROW(grid_draw_row_16, 16)
+GRID_DRAW_ROW(grid_draw_row_generic, grid->scale)
 
-static inline unsigned int wrap(int i, unsigned int max)
+static void grid_draw_row_palette(struct grid *grid, const uint8_t *cells,
+				  uint32_t *ptr)
 {
-	if (i < 0)
-		return i + max;
+	unsigned int x, i, p, state;
 
-	if (i >= max)
-		return i - max;
+	for (x = 0; x < grid->width; x++, ptr += grid->scale) {
+		for (state = 0, p = 0; p < grid->planes; p++)
+			state |= ((cells[p * grid->plane_size + x / 8] >>
+				   (x % 8)) & 1) << p;
 
-	return i;
+		for (i = 0; i < grid->scale; i++)
+			ptr[i] = grid->palette[state];
+	}
 }
 
-static struct grid *grid_new(unsigned int width, unsigned int height,
-			     unsigned int scale)
+static void grid_draw_row_field(struct grid *grid, const uint8_t *cells,
+				uint32_t *ptr)
 {
-	unsigned int pitch = DIV_ROUND_UP(width / scale, 8);
-	size_t size = pitch * height / scale;
-	struct grid *grid;
+	lenia_draw_row((const float *)cells, grid->width, grid->scale,
+		       grid->dead, grid->alive, ptr);
+}
 
-	grid = calloc(1, sizeof(*grid));
-	if (!grid)
-		return NULL;
+static const struct {
+	unsigned int scale;
+	void (*draw_row)(struct grid *grid, const uint8_t *cells,
+			 uint32_t *ptr);
+} grid_draw_kernels[] = {
+	{  1, grid_draw_row_1 },
+	{  2, grid_draw_row_2 },
+	{  3, grid_draw_row_3 },
+	{  4, grid_draw_row_4 },
+	{  8, grid_draw_row_8 },
+	{ 16, grid_draw_row_16 },
+};
+
+/*
+ * Set up drawing of the grid with each cell as a square of scale pixels,
+ * which the framebuffer rows are filled with by the row kernel for that
+ * scale. Universes smaller than the screen are drawn centred on it.
+ */
+static int grid_draw_setup(struct grid *grid, unsigned int scale,
+			   unsigned int width, unsigned int height)
+{
+	unsigned int i;
 
-	grid->width = width / scale;
-	grid->pitch = pitch;
-	grid->height = height / scale;
 	grid->scale = scale;
+	grid->left = (width - grid->width * scale) / 2;
+	grid->top = (height - grid->height * scale) / 2;
+	grid->alive = 0xffffffff;
+	grid->dead = 0x00000000;
 
-	grid->cells = calloc(1, size);
-	if (!grid->cells) {
-		free(grid);
-		return NULL;
-	}
+	grid->draw_row = grid_draw_row_generic;
 
-	grid->parents = calloc(1, size);
-	if (!grid->parents) {
-		free(grid->cells);
-		free(grid);
-		return NULL;
+	for (i = 0; i < ARRAY_SIZE(grid_draw_kernels); i++) {
+		if (grid_draw_kernels[i].scale == scale) {
+			grid->draw_row = grid_draw_kernels[i].draw_row;
+			break;
+		}
 	}
 
-	return grid;
-}
+	if (grid->planes > 1)
+		grid->draw_row = grid_draw_row_palette;
 
-static void grid_free(struct grid *grid)
-{
-	if (grid) {
-		free(grid->parents);
-		free(grid->cells);
-	}
+	/* one scratch row per thread */
+	grid->rows = calloc(grid->width * scale * grid->pool->count,
+			    sizeof(uint32_t));
+	grid->palette = calloc(1 << grid->planes, sizeof(uint32_t));
+	if (!grid->rows || !grid->palette)
+		return -ENOMEM;
 
-	free(grid);
+	return 0;
 }
 
-static inline loff_t grid_offset(struct grid *grid, unsigned int x,
-				 unsigned int y)
+static void *grid_origin(struct grid *grid, void *surface, unsigned int pitch)
 {
-	return y * grid->pitch + (x / 8);
+	return surface + grid->top * pitch + grid->left * sizeof(uint32_t);
 }
 
-static inline loff_t grid_row_offset(struct grid *grid, unsigned int y)
-{
-	return y * grid->pitch;
-}
+struct grid_draw_args {
+	struct grid *grid;
+	unsigned int pitch;
+	void *surface;
+	/* row of the universe drawn at the top of the surface */
+	unsigned int origin;
+	bool redraw;
+};
 
-static void grid_tick_cell(struct grid *grid, unsigned int x, unsigned int y)
+/*
+ * Each row of cells is expanded once. For scales larger than one it is
+ * expanded into a cached scratch row and then copied to the scale rows of
+ * the framebuffer, which avoids reading back from the (typically
+ * write-combined) framebuffer.
+ *
+ * Hexagonal universes are stored skewed, so each row is drawn half a cell
+ * further left than the one above it, wrapping around at the edges. This
+ * puts the six neighbours of each cell at equal distances.
+ */
+static void grid_draw_line(struct grid_draw_args *args, unsigned int y,
+			   uint32_t *row)
 {
-	unsigned int k, l, count = 0;
-	uint8_t *p, *c;
-	int i, j;
-
-	for (j = -1; j <= 1; j++) {
-		l = wrap(y + j, grid->height);
+	struct grid *grid = args->grid;
+	unsigned int width = grid->width * grid->scale, shift = 0, i;
+	size_t size = width * sizeof(uint32_t);
+	const uint8_t *cells = grid->cells + grid_row_offset(grid, y);
+	void *ptr = args->surface + y * grid->scale * args->pitch;
 
-		p = grid->parents + grid_row_offset(grid, l);
+	if (grid->lenia)
+		cells = (const uint8_t *)lenia_row(grid->lenia, y);
 
-		for (i = -1; i <= 1; i++) {
-			if (i == 0 && j == 0)
-				continue;
+	if (grid->rule && grid->rule->neighbourhood == RULE_HEXAGONAL)
+		shift = (args->origin + y) * grid->scale / 2 % width;
 
-			k = wrap(x + i, grid->width);
+	if (grid->scale == 1 && !shift) {
+		grid->draw_row(grid, cells, ptr);
+		return;
+	}
 
-			if (p[k / 8] & BIT(k % 8))
-				count++;
+	grid->draw_row(grid, cells, row);
+
+	for (i = 0; i < grid->scale; i++) {
+		if (shift) {
+			memcpy(ptr + i * args->pitch, row + shift,
+			       (width - shift) * sizeof(uint32_t));
+			memcpy(ptr + i * args->pitch +
+			       (width - shift) * sizeof(uint32_t), row,
+			       shift * sizeof(uint32_t));
+		} else {
+			memcpy(ptr + i * args->pitch, row, size);
 		}
 	}
+}
 
-	p = grid->parents + grid_offset(grid, x, y);
-	c = grid->cells + grid_offset(grid, x, y);
+/* keep band boundaries on framebuffer cache line boundaries */
+static void grid_draw_band_rows(struct grid_draw_args *args,
+				unsigned int index, unsigned int count,
+				unsigned int *start, unsigned int *end)
+{
+	struct grid *grid = args->grid;
+	unsigned int align = 1;
 
-	if (*p & BIT(x % 8)) {
-		/* cell stays alive */
-		if (count == 2 || count == 3)
-			*c |= BIT(x % 8);
-	} else {
-		/* cell is born */
-		if (count == 3)
-			*c |= BIT(x % 8);
-	}
+	while ((align * grid->scale * args->pitch) % 64)
+		align *= 2;
+
+	grid_band(grid, index, count, align, start, end);
 }
 
-static void grid_tick(struct grid *grid)
+static void grid_draw_band(void *data, unsigned int index, unsigned int count)
 {
-	unsigned int x, y;
+	struct grid_draw_args *args = data;
+	struct grid *grid = args->grid;
+	uint32_t *row = grid->rows + index * grid->width * grid->scale;
+	unsigned int start, end, y;
 
-	memset(grid->cells, 0, grid->pitch * grid->height);
+	grid_draw_band_rows(args, index, count, &start, &end);
 
-	for (y = 0; y < grid->height; y++)
-		for (x = 0; x < grid->width; x++)
-			grid_tick_cell(grid, x, y);
+	for (y = start; y < end; y++)
+		grid_draw_line(args, y, row);
+}
+
+/*
+ * Computes each row of the next generation and immediately expands it into
+ * the framebuffer while it is still in cache. The cells buffer holds the
+ * generation from two frames ago, which is what the back buffer shows, so
+ * rows that did not change since then are not drawn at all.
+ */
+static void grid_tick_draw_band(void *data, unsigned int index,
+				unsigned int count)
+{
+	struct grid_draw_args *args = data;
+	struct grid *grid = args->grid;
+	uint32_t *row = grid->rows + index * grid->width * grid->scale;
+	unsigned int start, end, y;
+
+	grid_draw_band_rows(args, index, count, &start, &end);
+
+	for (y = start; y < end; y++)
+		if (grid_tick_line(grid, y) || args->redraw)
+			grid_draw_line(args, y, row);
 }
 
-static void grid_draw(struct grid *grid, struct screen *screen)
+/*
+ * Rendering is split into horizontal bands, one per thread of the pool,
+ * since a single core cannot saturate the memory bandwidth. All bands are
+ * complete when this returns. If tick is true, the next generation is
+ * computed in the same pass and only rows that changed are redrawn unless
+ * redraw is set.
+ */
+static void grid_draw(struct grid *grid, struct screen *screen, bool tick,
+		      bool redraw)
 {
 	struct surface *fb = screen->fb[screen->current];
-	unsigned int x, y;
-	void *surface;
+	struct grid_draw_args args;
 	int err;
 
-	err = surface_lock(fb, &surface);
+	err = surface_lock(fb, &args.surface);
 	if (err < 0) {
 		fprintf(stderr, "surface_lock() failed\n");
 		return;
 	}
 
-	for (y = 0; y < grid->height; y++) {
-		uint8_t *cells = grid->cells + grid_row_offset(grid, y);
-		uint32_t *ptr[grid->scale];
-		unsigned int i, j;
+	args.grid = grid;
+	args.pitch = fb->bo->pitch;
+	args.surface = grid_origin(grid, args.surface, args.pitch);
+	args.origin = 0;
+	args.redraw = redraw;
 
-		for (i = 0; i < grid->scale; i++)
-			ptr[i] = surface + (y * grid->scale + i) *
-				 fb->bo->pitch;
+	if (tick)
+		pool_run(grid->pool, grid_tick_draw_band, &args);
+	else
+		pool_run(grid->pool, grid_draw_band, &args);
 
-		for (x = 0; x < grid->width; x++) {
-			uint32_t color;
+	surface_unlock(fb);
+}
 
-			if (cells[x / 8] & BIT(x % 8))
-				color = 0xffffffff;
-			else
-				color = 0x00000000;
+/*
+ * In sharded mode each worker process owns one band of rows. Each shard
+ * has two buffers in the shared memory segment, one per generation, with
+ * a halo row above and below its own rows. After computing a generation,
+ * a worker copies its first and last rows into the halos of its neighbours
+ * and draws its rows straight into the (shared) framebuffer mapping.
+ */
+struct grid_shards {
+	struct grid *grid;
+	struct shards *shards;
+	unsigned int *cpus;
+	unsigned int num_cpus;
+	unsigned int pitch;
+	void *fb[2];
+};
 
-			for (j = 0; j < grid->scale; j++)
-				for (i = 0; i < grid->scale; i++)
-					ptr[j][x * grid->scale + i] = color;
-		}
+static void *grid_shard_buffer(struct grid *grid, struct shards *shards,
+			       unsigned int index, unsigned int gen)
+{
+	unsigned int start, end, i;
+	size_t offset = 0;
+
+	for (i = 0; i < index; i++) {
+		grid_band(grid, i, shards->count, 1, &start, &end);
+		offset += 2 * (end - start + 2) * grid->pitch;
 	}
 
-	surface_unlock(fb);
+	grid_band(grid, index, shards->count, 1, &start, &end);
+	offset += (gen & 1) * (end - start + 2) * grid->pitch;
+
+	return shards->data + offset;
 }
 
-static void grid_swap(struct grid *grid)
+static size_t grid_shards_size(struct grid *grid, unsigned int count)
 {
-	void *tmp = grid->parents;
-	grid->parents = grid->cells;
-	grid->cells = tmp;
+	return 2 * (grid->height + 2 * count) * grid->pitch;
 }
 
-static void grid_add_cell(struct grid *grid, unsigned int x, unsigned int y)
+static int grid_shard_worker(struct shards *shards, unsigned int index,
+			     void *data)
 {
-	uint8_t *p = grid->parents + grid_offset(grid, x, y);
+	struct grid_shards *gs = data;
+	struct grid *grid = gs->grid;
+	unsigned int count = shards->count, pitch = grid->pitch;
+	unsigned int prev = (index + count - 1) % count;
+	unsigned int next = (index + 1) % count;
+	unsigned int start, end, rows, prev_rows, gen, y;
+	struct grid_draw_args args;
+	struct grid view;
+	void *src, *dst;
+	int err;
 
-	*p |= BIT(x % 8);
+	if (gs->cpus) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(gs->cpus[index % gs->num_cpus], &set);
+
+		if (sched_setaffinity(0, sizeof(set), &set) < 0)
+			fprintf(stderr, "shard %u: failed to set CPU affinity: "
+				"%m\n", index);
+	}
+
+	grid_band(grid, prev, count, 1, &start, &end);
+	prev_rows = end - start;
+
+	grid_band(grid, index, count, 1, &start, &end);
+	rows = end - start;
+
+	view = *grid;
+	args.grid = &view;
+	args.pitch = gs->pitch;
+	args.origin = start;
+	args.redraw = true;
+
+	for (gen = 0; ; gen++) {
+		src = grid_shard_buffer(grid, shards, index, gen);
+		dst = grid_shard_buffer(grid, shards, index, gen + 1);
+
+		for (y = 1; y <= rows; y++)
+			grid_tick_row(grid, src + (y - 1) * pitch,
+				      src + y * pitch, src + (y + 1) * pitch,
+				      dst + y * pitch);
+
+		memcpy(grid_shard_buffer(grid, shards, prev, gen + 1) +
+		       (prev_rows + 1) * pitch, dst + pitch, pitch);
+		memcpy(grid_shard_buffer(grid, shards, next, gen + 1),
+		       dst + rows * pitch, pitch);
+
+		view.cells = dst + pitch;
+		args.surface = grid_origin(grid,
+					   gs->fb[shards->header->current],
+					   gs->pitch) +
+			       start * grid->scale * gs->pitch;
+
+		for (y = 0; y < rows; y++)
+			grid_draw_line(&args, y, grid->rows);
+
+		/* generation complete, wait for the presenter to flip */
+		err = shards_barrier(shards);
+		if (err < 0)
+			return err;
+
+		err = shards_barrier(shards);
+		if (err < 0)
+			return err;
+
+		if (__atomic_load_n(&shards->header->done, __ATOMIC_ACQUIRE))
+			return 0;
+	}
 }
 
-static void grid_randomize(struct grid *grid, unsigned int seed)
+/*
+ * Set up the shared segment from the current generation of the grid and
+ * fork the workers. Both framebuffers are mapped beforehand so that the
+ * workers inherit the mappings.
+ */
+static int grid_shards_start(struct grid_shards *gs, struct grid *grid,
+			     struct screen *screen, unsigned int count)
 {
-	unsigned int x, y;
+	unsigned int start, end, i, y;
+	void *buffer;
+	int err;
 
-	for (y = 0; y < grid->height; y++) {
-		for (x = 0; x < grid->width; x++) {
-			bool alive = rand_r(&seed) > RAND_MAX / 2;
-			if (alive)
-				grid_add_cell(grid, x, y);
-		}
+	if (count > grid->height)
+		return -EINVAL;
+
+	gs->grid = grid;
+	gs->pitch = screen->fb[0]->bo->pitch;
+
+	for (i = 0; i < 2; i++) {
+		err = surface_lock(screen->fb[i], &gs->fb[i]);
+		if (err < 0)
+			return err;
+	}
+
+	err = shards_create(&gs->shards, count, grid_shards_size(grid, count));
+	if (err < 0)
+		return err;
+
+	for (i = 0; i < count; i++) {
+		grid_band(grid, i, count, 1, &start, &end);
+		buffer = grid_shard_buffer(grid, gs->shards, i, 0);
+
+		for (y = 0; y < end - start + 2; y++)
+			memcpy(buffer + y * grid->pitch, grid->parents +
+			       grid_row_offset(grid, wrap((int)(start + y) - 1,
+							  grid->height)),
+			       grid->pitch);
+	}
+
+	gs->shards->header->current = screen->current;
+
+	err = shards_spawn(gs->shards, grid_shard_worker, gs);
+	if (err < 0) {
+		shards_free(gs->shards);
+		return err;
+	}
+
+	return 0;
+}
+
+static unsigned long grid_shards_population(struct grid_shards *gs,
+					    unsigned int gen)
+{
+	struct grid *grid = gs->grid;
+	unsigned long population = 0;
+	unsigned int start, end, i, j, y;
+	void *buffer;
+
+	for (i = 0; i < gs->shards->count; i++) {
+		grid_band(grid, i, gs->shards->count, 1, &start, &end);
+		buffer = grid_shard_buffer(grid, gs->shards, i, gen);
+
+		for (y = 1; y <= end - start; y++)
+			for (j = 0; j < grid->words; j++)
+				population += __builtin_popcountll(
+					grid_word(grid, buffer + y * grid->pitch,
+						  j));
 	}
+
+	return population;
 }
 
 static void grid_add_glider(struct grid *grid, unsigned int x, unsigned int y)
@@ -302,10 +559,62 @@ static void grid_add_acorn(struct grid *grid, unsigned int x, unsigned int y)
 	grid_add_cell(grid, x + 6, y + 0);
 }
 
+/*
+ * Returns the rule given in the header of an RLE file, if any. The rule
+ * decides the number of bit planes, so it is needed before the grid can
+ * be created.
+ */
+static char *rle_read_rule(const char *filename)
+{
+	char *line = NULL, *rule = NULL;
+	unsigned int width, height;
+	size_t len = 0;
+	FILE *fp;
+
+	fp = fopen(filename, "r");
+	if (!fp)
+		return NULL;
+
+	while (getline(&line, &len, fp) != -1) {
+		if (line[0] == 'x') {
+			sscanf(line, "x = %u, y = %u, rule = %ms", &width,
+			       &height, &rule);
+			break;
+		}
+	}
+
+	free(line);
+	fclose(fp);
+	return rule;
+}
+
+/* checks whether any of the engines can run a rule */
+static bool rle_rule_supported(const char *string)
+{
+	struct multistate_rule multistate;
+	struct margolus_rule margolus;
+	struct lenia_rule lenia;
+	struct ltl_rule ltl;
+	struct rule rule;
+	uint8_t wolfram;
+
+	return multistate_parse_rule(&multistate, string) == 0 ||
+	       margolus_parse_rule(&margolus, string) == 0 ||
+	       elementary_parse_rule(&wolfram, string) == 0 ||
+	       rule_parse(&rule, string) == 0 ||
+	       lenia_parse_rule(&lenia, string) == 0 ||
+	       ltl_parse_rule(&ltl, string) == 0;
+}
+
+/*
+ * Loads a pattern from an RLE file. Multi-state patterns use '.' for state
+ * 0, 'A' to 'X' for states 1 to 24 and a prefix of 'p' to 'y' for each
+ * further 24 states, e.g. "pA" for state 25.
+ */
 static int grid_load_rle(struct grid *grid, const char *filename,
 			 unsigned int x, unsigned int y)
 {
-	unsigned int width = 0, height = 0, s = 0, t = 0;
+	unsigned int width = 0, height = 0, s = 0, t = 0, state;
 	char *line = NULL, *rule = NULL, *end, *ptr;
 	unsigned long count;
 	size_t len = 0, i;
@@ -343,6 +652,23 @@ static int grid_load_rle(struct grid *grid, const char *filename,
 				count = 1;
 
 			ptr = end;
+			state = 0;
+
+			if (*ptr >= 'p' && *ptr <= 'y' && ptr[1] >= 'A' &&
+			    ptr[1] <= 'X')
+				state = (*ptr++ - 'p' + 1) * 24;
+
+			if (*ptr >= 'A' && *ptr <= 'X') {
+				state += *ptr - 'A' + 1;
+
+				for (i = 0; i < count; i++)
+					grid_set_state(grid, x + s + i, y + t,
+						       state);
+
+				s += count;
+				ptr++;
+				continue;
+			}
 
 			switch (*ptr) {
 			case 'o':
@@ -353,6 +679,7 @@ static int grid_load_rle(struct grid *grid, const char *filename,
 				break;
 
 			case 'b':
+			case '.':
 				s += count;
 				break;
 
@@ -370,153 +697,1665 @@ static int grid_load_rle(struct grid *grid, const char *filename,
 	return 0;
 }
 
-static bool done = false;
+struct theme {
+	const char *name;
+	uint32_t alive;
+	uint32_t dead;
+};
 
-static void signal_handler(int signum)
-{
-	if (signum == SIGINT)
-		done = true;
-}
+static const struct theme themes[] = {
+	{ "mono", 0xffffff, 0x000000 },
+	{ "inverse", 0x000000, 0xffffff },
+	{ "green", 0x33ff66, 0x001a0a },
+	{ "amber", 0xffb000, 0x1a0f00 },
+	{ "blue", 0x80c0ff, 0x000a28 },
+	{ "red", 0xff4020, 0x100000 },
+};
 
-static void usage(FILE *fp, const char *program)
+static const struct theme *theme_find(const char *name)
 {
-	fprintf(fp, "usage: %s [options] DEVICE\n", program);
-	fprintf(fp, "\n");
-	fprintf(fp, "options:\n");
-	fprintf(fp, "  -a, --acorn	start with acorn element\n");
-	fprintf(fp, "  -d, --die-hard	start with die-hard element\n");
-	fprintf(fp, "  -f, --framerate	set framerate\n");
-	fprintf(fp, "  -F, --file	start with element from file\n");
-	fprintf(fp, "  -g, --glider	start with glider element\n");
-	fprintf(fp, "  -G, --gun	start with glider gun\n");
-	fprintf(fp, "  -h, --help	display this help screen and exit\n");
-	fprintf(fp, "  -p, --pentomino	start with r-pentomino element\n");
-	fprintf(fp, "  -s, --seed	initial random seed\n");
-	fprintf(fp, "\n");
-}
+	unsigned int i;
 
-enum pattern {
-	RANDOM,
-	DIE_HARD,
-	GLIDER,
-	PENTOMINO,
-	GUN,
-	ACORN,
-};
+	for (i = 0; i < ARRAY_SIZE(themes); i++)
+		if (strcmp(themes[i].name, name) == 0)
+			return &themes[i];
 
-int main(int argc, char *argv[])
+	return NULL;
+}
+
+static inline uint16_t theme_channel(uint32_t dead, uint32_t alive,
+				     unsigned int shift, unsigned int i,
+				     unsigned int max, unsigned int level)
 {
-	static const struct option options[] = {
-		{ "acorn", 0, NULL, 'a' },
-		{ "die-hard", 0, NULL, 'd' },
-		{ "framerate", 1, NULL, 'f' },
-		{ "file", 1, NULL, 'F' },
-		{ "glider", 0, NULL, 'g' },
-		{ "gun", 0, NULL, 'G' },
-		{ "help", 0, NULL, 'h' },
-		{ "pentomino", 0, NULL, 'p' },
-		{ "seed", 1, NULL, 's' },
-		{ "scale", 1, NULL, 'S' },
-		{ NULL, 0, NULL, 0 },
-	};
-	static const char opts[] = "adf:F:gGhps:S:";
-	unsigned int seed = time(NULL);
-	enum pattern pattern = RANDOM;
-	unsigned int gen, scale = 1;
-	unsigned int framerate = 60;
-	const char *filename = NULL;
-	struct screen *screen;
-	struct sigaction sa;
-	const char *device;
-	bool help = false;
-	struct grid *grid;
-	unsigned int x, y;
-	int fd, err, opt;
+	unsigned int from = ((dead >> shift) & 0xff) * 0x101;
+	unsigned int to = ((alive >> shift) & 0xff) * 0x101;
+	int64_t value = from + ((int64_t)to - from) * i / max;
 
-	while ((opt = getopt_long(argc, argv, opts, options, NULL)) != -1) {
-		switch (opt) {
-		case 'a':
-			pattern = ACORN;
-			break;
+	return value * level / 0xffff;
+}
 
-		case 'd':
-			pattern = DIE_HARD;
-			break;
+/* scales a colour that is drawn directly to a brightness in percent */
+static uint32_t theme_dim(uint32_t color, unsigned int brightness)
+{
+	uint32_t result = color & 0xff000000;
+	unsigned int shift;
 
-		case 'f':
-			framerate = strtoul(optarg, NULL, 0);
-			break;
+	for (shift = 0; shift < 24; shift += 8)
+		result |= ((color >> shift) & 0xff) * brightness / 100 << shift;
 
-		case 'F':
-			filename = optarg;
-			break;
+	return result;
+}
 
-		case 'g':
-			pattern = GLIDER;
-			break;
+/*
+ * Cells are always drawn as full white or full black, so the gamma ramp of
+ * the CRTC maps those two levels onto the theme colours. Changing the theme
+ * or fading the display in or out then only needs to reprogram the ramp
+ * instead of redrawing every pixel. The level is 0-0xffff.
+ */
+static int theme_apply(const struct theme *theme, struct screen *screen,
+		       unsigned int level)
+{
+	unsigned int size = screen->gamma_size, max, i;
+	uint16_t *ramp;
+	int err;
 
-		case 'G':
-			pattern = GUN;
-			break;
+	if (size < 2)
+		return -ENOTSUP;
 
-		case 'h':
-			help = true;
-			break;
+	ramp = calloc(3 * size, sizeof(*ramp));
+	if (!ramp)
+		return -ENOMEM;
 
-		case 'p':
-			pattern = PENTOMINO;
-			break;
+	max = size - 1;
 
-		case 's':
-			seed = strtoul(optarg, NULL, 0);
-			break;
+	for (i = 0; i < size; i++) {
+		ramp[i] = theme_channel(theme->dead, theme->alive, 16, i, max,
+					level);
+		ramp[size + i] = theme_channel(theme->dead, theme->alive, 8,
+					       i, max, level);
+		ramp[2 * size + i] = theme_channel(theme->dead, theme->alive,
+						   0, i, max, level);
+	}
 
-		case 'S':
-			scale = strtoul(optarg, NULL, 0);
-			if (!scale) {
-				fprintf(stderr, "invalid scale: %s\n", optarg);
-				return 1;
-			}
-			break;
+	err = screen_set_gamma(screen, ramp, ramp + size, ramp + 2 * size);
+	free(ramp);
 
-		default:
-			usage(stderr, argv[0]);
-			return 1;
-		}
-	}
+	return err;
+}
 
-	if (help) {
-		usage(stdout, argv[0]);
-		return 0;
+static inline uint32_t palette_mix(uint32_t from, uint32_t to,
+				   unsigned int i, unsigned int max)
+{
+	uint32_t color = 0;
+	unsigned int shift;
+	int a, b;
+
+	for (shift = 0; shift < 32; shift += 8) {
+		a = (from >> shift) & 0xff;
+		b = (to >> shift) & 0xff;
+		color |= (uint32_t)(a + (b - a) * (int)i / (int)max) << shift;
 	}
 
-	if (optind >= argc)
-		device = DEFAULT_DEVICE;
-	else
-		device = argv[optind];
+	return color;
+}
 
-	fd = open(device, O_RDWR);
-	if (fd < 0) {
-		fprintf(stderr, "%s: open() failed: %m\n", device);
-		return 1;
+/*
+ * Dying cells of Generations rules fade from the live to the dead colour.
+ * As with two states, with a gamma ramp these are shades of grey that the
+ * ramp maps onto the theme. WireWorld uses its customary colours.
+ */
+static void grid_set_palette(struct grid *grid,
+			     const struct multistate_rule *rule)
+{
+	static const uint32_t wireworld[] = {
+		0x000000, 0x4080ff, 0xff4020, 0xffc000,
+	};
+	unsigned int i;
+
+	for (i = 0; i < 1u << grid->planes; i++) {
+		if (i == 0 || i >= rule->states)
+			grid->palette[i] = grid->dead;
+		else if (rule->family == MULTISTATE_WIREWORLD)
+			grid->palette[i] = wireworld[i];
+		else
+			grid->palette[i] = palette_mix(grid->alive, grid->dead,
+						       i - 1, rule->states - 1);
 	}
+}
 
-	err = screen_create(&screen, fd, 0, 0);
-	if (err < 0) {
-		fprintf(stderr, "screen_create() failed: %s\n", strerror(-err));
-		return 1;
-	}
+static inline double timespec_diff_ms(const struct timespec *end,
+				      const struct timespec *start)
+{
+	return (end->tv_sec - start->tv_sec) * 1000.0 +
+	       (end->tv_nsec - start->tv_nsec) / 1000000.0;
+}
 
-	grid = grid_new(screen->width, screen->height, scale);
-	if (!grid) {
+/*
+ * Soup search: random soups are run headless on small tori until their
+ * population becomes periodic. The remaining ash is then separated into
+ * objects which are added to a census. Each thread runs whole soups on a
+ * grid of its own.
+ */
+#define SOUP_SIZE 16
+#define SOUP_GRID 256
+#define SOUP_HISTORY 512
+#define SOUP_MAX_GENERATIONS 40000
+
+struct soup_search {
+	unsigned long count;
+	unsigned long next;
+	unsigned int seed;
+	struct census **census;
+	int err;
+};
+
+/*
+ * Returns the period of the population over the history or 0 if it is
+ * not periodic.
+ */
+static unsigned int soup_period(const unsigned long *history,
+				unsigned int gen)
+{
+	unsigned int period, i;
+
+	for (period = 1; period <= CENSUS_MAX_PERIOD; period++) {
+		for (i = 0; i < SOUP_HISTORY - period; i++)
+			if (history[(gen - i) % SOUP_HISTORY] !=
+			    history[(gen - i - period) % SOUP_HISTORY])
+				break;
+
+		if (i == SOUP_HISTORY - period)
+			return period;
+	}
+
+	return 0;
+}
+
+static void soup_unpack(struct grid *grid, const void *cells, uint8_t *bytes)
+{
+	unsigned int x, y;
+
+	for (y = 0; y < grid->height; y++) {
+		const void *row = cells + grid_row_offset(grid, y);
+
+		for (x = 0; x < grid->width; x++)
+			bytes[y * grid->width + x] =
+				(grid_word(grid, row, x / 64) >> (x % 64)) & 1;
+	}
+}
+
+static int soup_run(struct grid *grid, struct census *census,
+		    unsigned int seed, unsigned long *history, void *mask,
+		    uint8_t *cells, uint8_t *union_cells)
+{
+	unsigned int gen, period = 0, i;
+	uint64_t *dst = mask;
+	const uint64_t *src;
+
+	memset(grid->parents, 0, grid->size);
+	grid_randomize_area(grid, (grid->width - SOUP_SIZE) / 2,
+			    (grid->height - SOUP_SIZE) / 2, SOUP_SIZE,
+			    SOUP_SIZE, seed);
+
+	for (gen = 0; gen < SOUP_MAX_GENERATIONS; gen++) {
+		grid_tick(grid);
+		grid_swap(grid);
+
+		history[gen % SOUP_HISTORY] = grid_population(grid);
+
+		if (gen >= SOUP_HISTORY && gen % 64 == 0) {
+			period = soup_period(history, gen);
+			if (period)
+				break;
+		}
+	}
+
+	if (!period)
+		return census_add(census, "PATHOLOGICAL", 1);
+
+	/* collect the union of all phases */
+	memcpy(mask, grid->parents, grid->size);
+
+	for (gen = 0; gen < period; gen++) {
+		grid_tick(grid);
+		grid_swap(grid);
+
+		src = grid->parents;
+
+		for (i = 0; i < grid->size / sizeof(uint64_t); i++)
+			dst[i] |= src[i];
+	}
+
+	soup_unpack(grid, grid->parents, cells);
+	soup_unpack(grid, mask, union_cells);
+
+	return census_ash(census, cells, union_cells, grid->width,
+			  grid->height);
+}
+
+static void soup_search_band(void *data, unsigned int index,
+			     unsigned int count)
+{
+	size_t size = (size_t)SOUP_GRID * SOUP_GRID;
+	struct soup_search *search = data;
+	uint8_t *cells = NULL, *union_cells = NULL;
+	unsigned long *history = NULL, soup;
+	struct pool *pool = NULL;
+	struct grid *grid = NULL;
+	void *mask = NULL;
+	int err;
+
+	err = pool_create(&pool, 1);
+	if (err < 0)
+		goto out;
+
+	err = census_create(&search->census[index]);
+	if (err < 0)
+		goto cleanup;
+
+	grid = grid_new(SOUP_GRID, SOUP_GRID, 1, pool, NUMA_DEFAULT, false);
+	history = calloc(SOUP_HISTORY, sizeof(*history));
+	cells = malloc(size);
+	union_cells = malloc(size);
+
+	if (!grid || !history || !cells || !union_cells) {
+		err = -ENOMEM;
+		goto cleanup;
+	}
+
+	mask = grid_alloc(grid->size, NUMA_DEFAULT);
+	if (!mask) {
+		err = -ENOMEM;
+		goto cleanup;
+	}
+
+	while ((soup = __atomic_fetch_add(&search->next, 1,
+					  __ATOMIC_RELAXED)) < search->count) {
+		err = soup_run(grid, search->census[index],
+			       search->seed + soup, history, mask, cells,
+			       union_cells);
+		if (err < 0)
+			break;
+	}
+
+cleanup:
+	if (mask)
+		munmap(mask, grid->size);
+
+	free(union_cells);
+	free(cells);
+	free(history);
+
+	if (grid)
+		grid_free(grid);
+
+	pool_free(pool);
+out:
+	if (err < 0) {
+		__atomic_store_n(&search->err, err, __ATOMIC_RELAXED);
+		/* make the other threads stop early */
+		__atomic_store_n(&search->next, search->count,
+				 __ATOMIC_RELAXED);
+	}
+}
+
+static int soup_search(struct pool *pool, unsigned long count,
+		       unsigned int seed)
+{
+	struct soup_search search = { 0 };
+	struct timespec start, end;
+	struct census *census;
+	double elapsed;
+	unsigned int i;
+	int err;
+
+	search.census = calloc(pool->count, sizeof(*search.census));
+	if (!search.census)
+		return -ENOMEM;
+
+	search.count = count;
+	search.seed = seed;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pool_run(pool, soup_search_band, &search);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	err = search.err;
+	census = search.census[0];
+
+	for (i = 1; i < pool->count && err == 0; i++)
+		err = census_merge(census, search.census[i]);
+
+	if (err == 0) {
+		elapsed = timespec_diff_ms(&end, &start) / 1000.0;
+
+		printf("# %lu soups of %ux%u cells, seeds %u-%lu\n", count,
+		       SOUP_SIZE, SOUP_SIZE, seed, seed + count - 1);
+		census_print(census, stdout);
+
+		fprintf(stderr, "%lu soups in %.1f s (%.0f soups/hour)\n",
+			count, elapsed, elapsed > 0 ?
+			count * 3600.0 / elapsed : 0.0);
+	}
+
+	for (i = 0; i < pool->count; i++)
+		if (search.census[i])
+			census_free(search.census[i]);
+
+	free(search.census);
+
+	return err;
+}
+
+/*
+ * Ensemble runs simulate 64 small universes, seeded with consecutive seeds,
+ * together until all of them have become periodic.
+ */
+#define ENSEMBLE_SIZE 64
+
+static int ensemble_run(struct pool *pool, unsigned int generations,
+			unsigned int seed, struct ensemble **ensemblep)
+{
+	unsigned long population[ENSEMBLE_LANES];
+	struct ensemble *ensemble;
+	unsigned int lane;
+	int err;
+
+	err = ensemble_create(&ensemble, ENSEMBLE_SIZE, ENSEMBLE_SIZE);
+	if (err < 0)
+		return err;
+
+	for (lane = 0; lane < ENSEMBLE_LANES; lane++)
+		ensemble_randomize(ensemble, lane, seed + lane);
+
+	while (ensemble->generation < generations && ~ensemble->stable) {
+		err = ensemble_tick(ensemble, pool);
+		if (err < 0) {
+			ensemble_free(ensemble);
+			return err;
+		}
+	}
+
+	ensemble_population(ensemble, population);
+
+	printf("# %u generations, lane seed population period settled\n",
+	       ensemble->generation);
+
+	for (lane = 0; lane < ENSEMBLE_LANES; lane++) {
+		printf("%u %u %lu", lane, seed + lane, population[lane]);
+
+		if (ensemble->stable & (1ull << lane))
+			printf(" %u %u\n", ensemble->period[lane],
+			       ensemble->settled[lane]);
+		else
+			printf(" - -\n");
+	}
+
+	*ensemblep = ensemble;
+
+	return 0;
+}
+
+/* copies one lane of an ensemble into the center of a grid */
+static void grid_from_ensemble(struct grid *grid, struct ensemble *ensemble,
+			       unsigned int lane)
+{
+	unsigned int x0 = 0, y0 = 0, x, y;
+
+	if (grid->width > ensemble->width)
+		x0 = (grid->width - ensemble->width) / 2;
+
+	if (grid->height > ensemble->height)
+		y0 = (grid->height - ensemble->height) / 2;
+
+	for (y = 0; y < ensemble->height; y++)
+		for (x = 0; x < ensemble->width; x++)
+			if (ensemble_get(ensemble, x, y, lane))
+				grid_add_cell(grid, (x0 + x) % grid->width,
+					      (y0 + y) % grid->height);
+}
+
+/*
+ * Restores the generation the given number of steps away from the current
+ * one, clamped to the retained history. The generation is restored into
+ * the parents, from which the next tick continues, and copied to the
+ * cells so that it is drawn.
+ */
+static int grid_rewind(struct grid *grid, struct history *history,
+		       unsigned int *gen, int steps)
+{
+	long target = (long)*gen + steps;
+	int err;
+
+	if (target < (long)history_oldest(history))
+		target = history_oldest(history);
+
+	if (target > (long)history_newest(history))
+		target = history_newest(history);
+
+	err = history_seek(history, target, grid->parents);
+	if (err < 0)
+		return err;
+
+	memcpy(grid->cells, grid->parents, (size_t)grid->pitch * grid->height);
+	*gen = target;
+
+	return 0;
+}
+
+/*
+ * Runs a reversible rule the given number of steps forwards or backwards,
+ * at most back to generation 0, and copies the result to the cells so that
+ * it is drawn.
+ */
+static int grid_step(struct grid *grid, unsigned int *gen, int steps)
+{
+	bool backwards = steps < 0;
+	int err;
+
+	if (backwards && -steps > (int)*gen)
+		steps = -(int)*gen;
+
+	while (steps) {
+		err = margolus_tick(grid->margolus, grid->pool, grid->parents,
+				    grid->cells, backwards);
+		if (err < 0)
+			return err;
+
+		grid_swap(grid);
+
+		if (backwards) {
+			(*gen)--;
+			steps++;
+		} else {
+			(*gen)++;
+			steps--;
+		}
+	}
+
+	memcpy(grid->cells, grid->parents, (size_t)grid->pitch * grid->height);
+
+	return 0;
+}
+
+static struct termios terminal;
+static bool terminal_raw;
+
+static void terminal_restore(void)
+{
+	if (terminal_raw)
+		tcsetattr(STDIN_FILENO, TCSANOW, &terminal);
+
+	terminal_raw = false;
+}
+
+/* read single key presses from the terminal without blocking */
+static void terminal_setup(void)
+{
+	struct termios raw;
+
+	if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &terminal) < 0)
+		return;
+
+	raw = terminal;
+	raw.c_lflag &= ~(ICANON | ECHO);
+	raw.c_cc[VMIN] = 0;
+	raw.c_cc[VTIME] = 0;
+
+	/* error paths that return from main() restore the terminal too */
+	if (atexit(terminal_restore) < 0)
+		return;
+
+	if (tcsetattr(STDIN_FILENO, TCSANOW, &raw) == 0)
+		terminal_raw = true;
+}
+
+static int terminal_key(void)
+{
+	unsigned char key;
+
+	if (!terminal_raw || read(STDIN_FILENO, &key, 1) != 1)
+		return -1;
+
+	return key;
+}
+
+/*
+ * Parse a list of CPUs such as "0-3,6" into an array. Returns the number
+ * of CPUs or a negative error code.
+ */
+static int parse_cpus(const char *list, unsigned int **cpusp)
+{
+	unsigned long first, last, cpu;
+	unsigned int *cpus = NULL, *tmp;
+	const char *ptr = list;
+	unsigned int count = 0;
+	char *end;
+
+	while (*ptr) {
+		first = strtoul(ptr, &end, 10);
+		if (end == ptr)
+			goto invalid;
+
+		last = first;
+		ptr = end;
+
+		if (*ptr == '-') {
+			ptr++;
+
+			last = strtoul(ptr, &end, 10);
+			if (end == ptr || last < first)
+				goto invalid;
+
+			ptr = end;
+		}
+
+		if (last >= CPU_SETSIZE)
+			goto invalid;
+
+		for (cpu = first; cpu <= last; cpu++) {
+			tmp = realloc(cpus, (count + 1) * sizeof(*cpus));
+			if (!tmp) {
+				free(cpus);
+				return -ENOMEM;
+			}
+
+			cpus = tmp;
+			cpus[count++] = cpu;
+		}
+
+		if (*ptr == ',')
+			ptr++;
+		else if (*ptr)
+			goto invalid;
+	}
+
+	if (!count)
+		goto invalid;
+
+	*cpusp = cpus;
+
+	return count;
+
+invalid:
+	free(cpus);
+	return -EINVAL;
+}
+
+/*
+ * Returns the file descriptor if the device is given as the number of an
+ * open DRM device, as done for lease instances, or -1 otherwise. The
+ * standard streams are never taken for one.
+ */
+static int parse_fd(const char *device)
+{
+	drmVersionPtr version;
+	unsigned long value;
+	char *end;
+
+	value = strtoul(device, &end, 10);
+	if (end == device || *end || value <= STDERR_FILENO ||
+	    value > INT_MAX)
+		return -1;
+
+	if (fcntl(value, F_GETFD) < 0)
+		return -1;
+
+	version = drmGetVersion(value);
+	if (!version)
+		return -1;
+
+	drmFreeVersion(version);
+
+	return value;
+}
+
+static bool done = false;
+
+static void signal_handler(int signum)
+{
+	if (signum == SIGINT || signum == SIGTERM)
+		done = true;
+}
+
+#define BEAM_BANDS 16
+
+/*
+ * When racing the beam there is a single buffer on screen. After each
+ * vertical blank the rows are drawn in bands, each as soon as the beam has
+ * scanned out its last line, so that the band shows from the next refresh
+ * on and is never torn. When the beam will be is predicted from the vblank
+ * timestamp and the timings of the mode. A band is late if it is not done
+ * before the beam comes around to its first line again.
+ */
+struct beam {
+	struct timespec vblank;
+	unsigned int sequence;
+	uint64_t line_ns;
+	unsigned int lines;
+	bool started;
+
+	/* telemetry */
+	unsigned long frames;
+	unsigned long bands;
+	unsigned long late;
+	unsigned long missed;
+	double max_lag;
+};
+
+struct beam_draw_args {
+	struct grid_draw_args draw;
+	unsigned int start;
+	unsigned int end;
+};
+
+static void beam_init(struct beam *beam, struct screen *screen)
+{
+	drmModeModeInfo *mode = &screen->mode;
+
+	beam->line_ns = (uint64_t)mode->htotal * 1000000 / mode->clock;
+	beam->lines = mode->vtotal;
+
+	if (mode->flags & DRM_MODE_FLAG_DBLSCAN)
+		beam->line_ns *= 2;
+}
+
+static void beam_time(struct beam *beam, double lines, struct timespec *ts)
+{
+	uint64_t ns = beam->vblank.tv_nsec + lines * beam->line_ns;
+
+	ts->tv_sec = beam->vblank.tv_sec + ns / 1000000000;
+	ts->tv_nsec = ns % 1000000000;
+}
+
+/* split the rows of a band between the threads of the pool */
+static void beam_draw_rows(void *data, unsigned int index, unsigned int count)
+{
+	struct beam_draw_args *args = data;
+	struct grid *grid = args->draw.grid;
+	uint32_t *row = grid->rows + index * grid->width * grid->scale;
+	unsigned int rows = args->end - args->start, y;
+
+	for (y = args->start + rows * index / count;
+	     y < args->start + rows * (index + 1) / count; y++)
+		grid_draw_line(&args->draw, y, row);
+}
+
+static void beam_draw(struct beam *beam, struct grid *grid,
+		      struct screen *screen)
+{
+	struct surface *fb = screen->fb[screen->current ^ 1];
+	unsigned int sequence, i, first, last;
+	struct beam_draw_args args;
+	struct timespec deadline, now;
+	double lag;
+	int err;
+
+	err = surface_lock(fb, &args.draw.surface);
+	if (err < 0) {
+		fprintf(stderr, "surface_lock() failed\n");
+		return;
+	}
+
+	args.draw.grid = grid;
+	args.draw.pitch = fb->bo->pitch;
+	args.draw.surface = grid_origin(grid, args.draw.surface,
+					args.draw.pitch);
+	args.draw.origin = 0;
+	args.draw.redraw = true;
+
+	err = screen_wait_vblank(screen, &sequence, &beam->vblank);
+	if (err < 0) {
+		fprintf(stderr, "screen_wait_vblank() failed: %s\n",
+			strerror(-err));
+		surface_unlock(fb);
+		return;
+	}
+
+	if (beam->frames && sequence - beam->sequence > 1)
+		beam->missed += sequence - beam->sequence - 1;
+
+	beam->sequence = sequence;
+	beam->frames++;
+
+	for (i = 0; i < BEAM_BANDS; i++) {
+		grid_band(grid, i, BEAM_BANDS, 1, &args.start, &args.end);
+		if (args.start == args.end)
+			continue;
+
+		first = grid->top + args.start * grid->scale;
+		last = grid->top + args.end * grid->scale;
+
+		beam_time(beam, last, &deadline);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline,
+				NULL);
+
+		pool_run(grid->pool, beam_draw_rows, &args);
+
+		/* lines that the beam was past the first one of the band */
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		lag = timespec_diff_ms(&now, &beam->vblank) * 1000000.0 /
+		      beam->line_ns - beam->lines - first;
+
+		if (lag > 0) {
+			if (lag > beam->max_lag)
+				beam->max_lag = lag;
+
+			beam->late++;
+		}
+
+		beam->bands++;
+	}
+
+	surface_unlock(fb);
+}
+
+/* draw a whole frame, straight into the front buffer when racing the beam */
+static void grid_draw_frame(struct grid *grid, struct screen *screen,
+			    struct beam *beam)
+{
+	if (beam && beam->started)
+		beam_draw(beam, grid, screen);
+	else
+		grid_draw(grid, screen, false, true);
+}
+
+/*
+ * Elementary automata are shown as a waterfall, with each generation added
+ * as a row at the bottom of the screen. The framebuffer is twice as tall
+ * as the screen and holds each row in both halves, so the latest rows are
+ * always a contiguous window of it and scrolling only moves the scanout
+ * offset. A generation costs the writes of one row instead of a redraw.
+ */
+static int waterfall_run(struct grid *grid, struct screen *screen,
+			 struct elementary *elementary, unsigned int framerate)
+{
+	unsigned int rows = grid->height, scale = grid->scale, row, i;
+	size_t size = grid->width * scale * sizeof(uint32_t);
+	unsigned long gen = 0;
+	struct surface *fb;
+	uint32_t *pixels;
+	unsigned int pitch;
+	void *ptr;
+	int err;
+
+	err = surface_create(&fb, screen, screen->width, 2 * rows * scale, 32);
+	if (err < 0)
+		return err;
+
+	err = surface_lock(fb, &ptr);
+	if (err < 0)
+		goto destroy;
+
+	pitch = fb->bo->pitch;
+
+	for (pixels = ptr, i = 0; i < fb->bo->size / 4; i++)
+		pixels[i] = grid->dead;
+
+	err = screen_pan(screen, fb, 0, 0);
+
+	while (!done && err == 0) {
+		row = gen % rows;
+
+		grid->draw_row(grid, (const uint8_t *)elementary->cells,
+			       grid->rows);
+
+		/*
+		 * The copy in the upper half is the top row of the current
+		 * window, so it is only written once the window has moved.
+		 */
+		for (i = 0; i < scale; i++)
+			memcpy(ptr + ((row + rows) * scale + i) * pitch,
+			       grid->rows, size);
+
+		err = screen_pan(screen, fb, 0, (row + 1) * scale);
+
+		for (i = 0; i < scale; i++)
+			memcpy(ptr + (row * scale + i) * pitch, grid->rows,
+			       size);
+
+		/* a framerate of 0 freezes the waterfall */
+		while (!framerate && !done)
+			usleep(20000);
+
+		if (framerate > 0)
+			usleep(1000000 / framerate);
+
+		elementary_tick(elementary);
+		gen++;
+	}
+
+	surface_unlock(fb);
+
+	/* leave the regular framebuffer on screen before freeing this one */
+	screen_pan(screen, screen->fb[screen->current], 0, 0);
+
+destroy:
+	surface_destroy(fb);
+	return err;
+}
+
+/*
+ * Leases every connected output to an instance of its own. The instances
+ * run with the same options, except that each one gets a different seed
+ * and, if a CPU list was given, its share of the CPUs. The option for the
+ * lease manager is passed on as well, however it was spelled, instances
+ * ignore it since their device is an inherited file descriptor.
+ */
+static int lease_run(int fd, char *argv[], unsigned int argc,
+		     unsigned int seed, const unsigned int *cpus,
+		     unsigned int num_cpus)
+{
+	char seed_arg[32], device[16], *cpu_arg = NULL, **args;
+	struct lease_manager *manager;
+	unsigned int i, j, n, first, last, failed;
+	size_t len;
+	int err;
+
+	err = lease_manager_create(&manager, fd);
+	if (err < 0) {
+		fprintf(stderr, "lease_manager_create() failed: %s\n",
+			strerror(-err));
+		return err;
+	}
+
+	args = calloc(argc + 4, sizeof(*args));
+	if (cpus)
+		cpu_arg = malloc(16 + num_cpus * 8);
+
+	if (!args || (cpus && !cpu_arg)) {
+		err = -ENOMEM;
+		goto free;
+	}
+
+	for (i = 0; i < manager->count; i++) {
+		for (n = 0; n < argc; n++)
+			args[n] = argv[n];
+
+		snprintf(seed_arg, sizeof(seed_arg), "--seed=%u", seed + i);
+		args[n++] = seed_arg;
+
+		if (cpus) {
+			if (num_cpus >= manager->count) {
+				first = i * num_cpus / manager->count;
+				last = (i + 1) * num_cpus / manager->count;
+			} else {
+				first = i % num_cpus;
+				last = first + 1;
+			}
+
+			len = sprintf(cpu_arg, "--cpus=");
+
+			for (j = first; j < last; j++)
+				len += sprintf(cpu_arg + len, "%s%u",
+					       j > first ? "," : "", cpus[j]);
+
+			args[n++] = cpu_arg;
+		}
+
+		snprintf(device, sizeof(device), "%d", manager->leases[i].fd);
+		args[n++] = device;
+		args[n] = NULL;
+
+		err = lease_manager_spawn(manager, i, args);
+		if (err < 0) {
+			fprintf(stderr, "failed to start instance %u: %s\n", i,
+				strerror(-err));
+			break;
+		}
+	}
+
+	/* the instances handle interrupts themselves */
+	signal(SIGINT, SIG_IGN);
+
+	failed = lease_manager_wait(manager);
+	if (failed && err == 0)
+		err = -ECHILD;
+
+free:
+	free(cpu_arg);
+	free(args);
+	lease_manager_free(manager);
+	return err;
+}
+
+static void usage(FILE *fp, const char *program)
+{
+	fprintf(fp, "usage: %s [options] [DEVICE]\n", program);
+	fprintf(fp, "\n");
+	fprintf(fp, "options:\n");
+	fprintf(fp, "  -a, --acorn	start with acorn element\n");
+	fprintf(fp, "  -b, --brightness	brightness in percent (default: 100)\n");
+	fprintf(fp, "  -B, --benchmark	present the given number of frames as fast as\n");
+	fprintf(fp, "		possible and print presentation statistics\n");
+	fprintf(fp, "  -c, --cpus	pin threads to a list of CPUs (e.g. 0-3,6)\n");
+	fprintf(fp, "  -d, --die-hard	start with die-hard element\n");
+	fprintf(fp, "  -e, --ensemble	run 64 small universes for up to the given number\n");
+	fprintf(fp, "		of generations and print their statistics\n");
+	fprintf(fp, "  -E, --lane	display the given lane of the ensemble\n");
+	fprintf(fp, "  -f, --framerate	set framerate\n");
+	fprintf(fp, "  -F, --file	start with element from file\n");
+	fprintf(fp, "  -g, --glider	start with glider element\n");
+	fprintf(fp, "  -G, --gun	start with glider gun\n");
+	fprintf(fp, "  -h, --help	display this help screen and exit\n");
+	fprintf(fp, "  -u, --fused	compute and draw each row in a single pass\n");
+	fprintf(fp, "  -H, --hud	display statistics\n");
+	fprintf(fp, "  -i, --fade-in	fade in over the given number of frames\n");
+	fprintf(fp, "  -I, --in-place	update the grid in place to save memory\n");
+	fprintf(fp, "  -j, --threads	number of rendering threads\n");
+	fprintf(fp, "  -k, --shards	simulate in the given number of processes\n");
+	fprintf(fp, "  -l, --mlock	lock all memory to avoid page faults\n");
+	fprintf(fp, "  -L, --layout	cell storage layout (linear, tiles, morton)\n");
+	fprintf(fp, "  -m, --lease-manager	lease each connected output to an instance of\n");
+	fprintf(fp, "		its own\n");
+	fprintf(fp, "  -n, --numa	NUMA policy for the grid (local, interleave)\n");
+	fprintf(fp, "  -o, --soup-search	run the given number of soups headless and print\n");
+	fprintf(fp, "		a census of the resulting objects\n");
+	fprintf(fp, "  -p, --pentomino	start with r-pentomino element\n");
+	fprintf(fp, "  -r, --rt-priority	run with SCHED_FIFO real-time priority\n");
+	fprintf(fp, "  -R, --rule	rule to run, overrides the rule of an RLE file\n");
+	fprintf(fp, "		(B3/S23, B2-a/S12, B2/S34H, B2/S013V, /2/3,\n");
+	fprintf(fp, "		WireWorld, Critters, M0,8,4,3,2,5,9,7,1,6,10,11,12,\n");
+	fprintf(fp, "		13,14,15, W110, R5,C0,M1,S34..58,B34..45,NM,\n");
+	fprintf(fp, "		Lenia or SmoothLife,R12,B0.278..0.365,S0.267..0.445)\n");
+	fprintf(fp, "  -s, --seed	initial random seed\n");
+	fprintf(fp, "  -t, --theme	colour theme (mono, inverse, green, amber, blue, red)\n");
+	fprintf(fp, "  -w, --swap	how frames are presented (setcrtc, flip, atomic)\n");
+	fprintf(fp, "  -y, --history	keep up to the given number of MiB of history\n");
+	fprintf(fp, "  -Y, --keyframes	store a keyframe every given number of generations\n");
+	fprintf(fp, "		(default: %u)\n", DEFAULT_KEYFRAMES);
+	fprintf(fp, "  -z, --race-beam	draw into the front buffer just behind the beam\n");
+	fprintf(fp, "\n");
+	fprintf(fp, "DEVICE defaults to %s and can also be the number of an\n", DEFAULT_DEVICE);
+	fprintf(fp, "inherited file descriptor, such as that of a DRM lease.\n");
+	fprintf(fp, "--lease-manager is ignored for such devices.\n");
+	fprintf(fp, "\n");
+	fprintf(fp, "With --history or a reversible block rule such as Critters, the\n");
+	fprintf(fp, "following keys are available:\n");
+	fprintf(fp, "  space	pause or resume, resuming discards newer generations\n");
+	fprintf(fp, "  , .	step one generation backwards or forwards\n");
+	fprintf(fp, "  < >	step 100 generations backwards or forwards\n");
+	fprintf(fp, "\n");
+}
+
+enum pattern {
+	RANDOM,
+	DIE_HARD,
+	GLIDER,
+	PENTOMINO,
+	GUN,
+	ACORN,
+};
+
+int main(int argc, char *argv[])
+{
+	static const struct option options[] = {
+		{ "acorn", 0, NULL, 'a' },
+		{ "brightness", 1, NULL, 'b' },
+		{ "benchmark", 1, NULL, 'B' },
+		{ "cpus", 1, NULL, 'c' },
+		{ "die-hard", 0, NULL, 'd' },
+		{ "ensemble", 1, NULL, 'e' },
+		{ "lane", 1, NULL, 'E' },
+		{ "framerate", 1, NULL, 'f' },
+		{ "file", 1, NULL, 'F' },
+		{ "glider", 0, NULL, 'g' },
+		{ "gun", 0, NULL, 'G' },
+		{ "help", 0, NULL, 'h' },
+		{ "hud", 0, NULL, 'H' },
+		{ "fade-in", 1, NULL, 'i' },
+		{ "in-place", 0, NULL, 'I' },
+		{ "threads", 1, NULL, 'j' },
+		{ "shards", 1, NULL, 'k' },
+		{ "mlock", 0, NULL, 'l' },
+		{ "layout", 1, NULL, 'L' },
+		{ "lease-manager", 0, NULL, 'm' },
+		{ "numa", 1, NULL, 'n' },
+		{ "soup-search", 1, NULL, 'o' },
+		{ "pentomino", 0, NULL, 'p' },
+		{ "rt-priority", 1, NULL, 'r' },
+		{ "seed", 1, NULL, 's' },
+		{ "scale", 1, NULL, 'S' },
+		{ "rule", 1, NULL, 'R' },
+		{ "theme", 1, NULL, 't' },
+		{ "race-beam", 0, NULL, 'z' },
+		{ "history", 1, NULL, 'y' },
+		{ "keyframes", 1, NULL, 'Y' },
+		{ "fused", 0, NULL, 'u' },
+		{ "swap", 1, NULL, 'w' },
+		{ NULL, 0, NULL, 0 },
+	};
+	static const char opts[] = "ab:B:c:de:E:f:F:gGhHi:Ij:k:lL:mn:o:pr:R:s:S:t:uw:y:Y:z";
+	unsigned int seed = time(NULL);
+	enum pattern pattern = RANDOM;
+	unsigned int gen, scale = 1;
+	unsigned int framerate = 60;
+	const struct theme *theme = &themes[0];
+	unsigned int brightness = 100;
+	unsigned int fade = 0, frame;
+	struct timespec start, end, last;
+	unsigned int frames = 0, steps = 0;
+	double frame_time = 0;
+	enum screen_swap_mode swap_mode = SCREEN_SWAP_SETCRTC;
+	struct timespec startup, bench_start, bench_cpu;
+	unsigned int benchmark = 0;
+	struct beam beam = { 0 };
+	bool race_beam = false;
+	unsigned int threads = 0;
+	unsigned long soups = 0;
+	struct ensemble *ensemble = NULL;
+	unsigned int generations = 0;
+	int lane = -1;
+	unsigned int keyframes = DEFAULT_KEYFRAMES;
+	struct history *history = NULL;
+	unsigned long history_size = 0;
+	bool paused = false;
+	int key;
+	char *rle_rule = NULL;
+	struct multistate_rule multistate_rule;
+	bool multistate = false;
+	struct margolus_rule margolus_rule;
+	bool margolus = false;
+	bool continuous = false;
+	struct elementary *elementary = NULL;
+	bool waterfall = false;
+	uint8_t wolfram;
+	unsigned int planes = 1;
+	const char *rule = NULL;
+	struct rule life_rule;
+	struct ltl_rule ltl_rule;
+	struct ltl *ltl = NULL;
+	struct lenia_rule lenia_rule;
+	struct lenia *lenia = NULL;
+	struct hud *hud = NULL;
+	bool show_hud = false;
+	unsigned int redraw;
+	unsigned int *cpus = NULL;
+	unsigned int priority = 0;
+	int num_cpus = 0;
+	enum numa_policy numa = NUMA_DEFAULT;
+	bool lock_memory = false;
+	bool in_place = false;
+	struct tiles *tiles = NULL;
+	bool tiled = false;
+	enum tile_order order = TILE_ORDER_ROWS;
+	unsigned int width, height;
+	struct grid_shards gs = { 0 };
+	unsigned int shards = 0;
+	int status = 0;
+	bool fused = false;
+	struct pool *pool;
+	bool gamma = true;
+	const char *filename = NULL;
+	struct screen *screen;
+	struct sigaction sa;
+	bool lease_manager = false;
+	const char *device;
+	bool help = false;
+	struct grid *grid;
+	unsigned int x, y;
+	int fd, err, opt;
+
+	clock_gettime(CLOCK_MONOTONIC, &startup);
+
+	while ((opt = getopt_long(argc, argv, opts, options, NULL)) != -1) {
+		switch (opt) {
+		case 'a':
+			pattern = ACORN;
+			break;
+
+		case 'b':
+			brightness = strtoul(optarg, NULL, 0);
+			if (brightness > 100) {
+				fprintf(stderr, "invalid brightness: %s\n",
+					optarg);
+				return 1;
+			}
+			break;
+
+		case 'B':
+			benchmark = strtoul(optarg, NULL, 0);
+			if (!benchmark) {
+				fprintf(stderr, "invalid number of frames: %s\n",
+					optarg);
+				return 1;
+			}
+			break;
+
+		case 'c':
+			num_cpus = parse_cpus(optarg, &cpus);
+			if (num_cpus < 0) {
+				fprintf(stderr, "invalid CPU list: %s\n",
+					optarg);
+				return 1;
+			}
+			break;
+
+		case 'd':
+			pattern = DIE_HARD;
+			break;
+
+		case 'e':
+			generations = strtoul(optarg, NULL, 0);
+			if (!generations) {
+				fprintf(stderr, "invalid number of generations: "
+					"%s\n", optarg);
+				return 1;
+			}
+			break;
+
+		case 'E':
+			lane = strtol(optarg, NULL, 0);
+			if (lane < 0 || lane >= ENSEMBLE_LANES) {
+				fprintf(stderr, "invalid lane: %s\n", optarg);
+				return 1;
+			}
+			break;
+
+		case 'f':
+			framerate = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'F':
+			filename = optarg;
+			break;
+
+		case 'g':
+			pattern = GLIDER;
+			break;
+
+		case 'G':
+			pattern = GUN;
+			break;
+
+		case 'h':
+			help = true;
+			break;
+
+		case 'H':
+			show_hud = true;
+			break;
+
+		case 'i':
+			fade = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'I':
+			in_place = true;
+			break;
+
+		case 'j':
+			threads = strtoul(optarg, NULL, 0);
+			if (!threads) {
+				fprintf(stderr, "invalid number of threads: "
+					"%s\n", optarg);
+				return 1;
+			}
+			break;
+
+		case 'l':
+			lock_memory = true;
+			break;
+
+		case 'k':
+			shards = strtoul(optarg, NULL, 0);
+			if (!shards) {
+				fprintf(stderr, "invalid number of shards: "
+					"%s\n", optarg);
+				return 1;
+			}
+			break;
+
+		case 'L':
+			if (strcmp(optarg, "linear") == 0) {
+				tiled = false;
+			} else if (strcmp(optarg, "tiles") == 0) {
+				order = TILE_ORDER_ROWS;
+				tiled = true;
+			} else if (strcmp(optarg, "morton") == 0) {
+				order = TILE_ORDER_MORTON;
+				tiled = true;
+			} else {
+				fprintf(stderr, "invalid layout: %s\n",
+					optarg);
+				return 1;
+			}
+			break;
+
+		case 'm':
+			lease_manager = true;
+			break;
+
+		case 'n':
+			if (strcmp(optarg, "local") == 0) {
+				numa = NUMA_LOCAL;
+			} else if (strcmp(optarg, "interleave") == 0) {
+				numa = NUMA_INTERLEAVE;
+			} else {
+				fprintf(stderr, "invalid NUMA policy: %s\n",
+					optarg);
+				return 1;
+			}
+			break;
+
+		case 'o':
+			soups = strtoul(optarg, NULL, 0);
+			if (!soups) {
+				fprintf(stderr, "invalid number of soups: "
+					"%s\n", optarg);
+				return 1;
+			}
+			break;
+
+		case 'p':
+			pattern = PENTOMINO;
+			break;
+
+		case 'r':
+			priority = strtoul(optarg, NULL, 0);
+			if ((int)priority < sched_get_priority_min(SCHED_FIFO) ||
+			    (int)priority > sched_get_priority_max(SCHED_FIFO)) {
+				fprintf(stderr, "invalid priority: %s\n",
+					optarg);
+				return 1;
+			}
+			break;
+
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'S':
+			scale = strtoul(optarg, NULL, 0);
+			if (!scale) {
+				fprintf(stderr, "invalid scale: %s\n", optarg);
+				return 1;
+			}
+			break;
+
+		case 'R':
+			rule = optarg;
+			break;
+
+		case 't':
+			theme = theme_find(optarg);
+			if (!theme) {
+				fprintf(stderr, "invalid theme: %s\n", optarg);
+				return 1;
+			}
+			break;
+
+		case 'u':
+			fused = true;
+			break;
+
+		case 'w':
+			if (strcmp(optarg, "setcrtc") == 0) {
+				swap_mode = SCREEN_SWAP_SETCRTC;
+			} else if (strcmp(optarg, "flip") == 0) {
+				swap_mode = SCREEN_SWAP_FLIP;
+			} else if (strcmp(optarg, "atomic") == 0) {
+				swap_mode = SCREEN_SWAP_ATOMIC;
+			} else {
+				fprintf(stderr, "invalid swap mode: %s\n",
+					optarg);
+				return 1;
+			}
+			break;
+
+		case 'y':
+			history_size = strtoul(optarg, NULL, 0);
+			if (!history_size) {
+				fprintf(stderr, "invalid history size: %s\n",
+					optarg);
+				return 1;
+			}
+			break;
+
+		case 'Y':
+			keyframes = strtoul(optarg, NULL, 0);
+			if (!keyframes) {
+				fprintf(stderr, "invalid keyframe interval: "
+					"%s\n", optarg);
+				return 1;
+			}
+			break;
+
+		case 'z':
+			race_beam = true;
+			break;
+
+		default:
+			usage(stderr, argv[0]);
+			return 1;
+		}
+	}
+
+	if (help) {
+		usage(stdout, argv[0]);
+		return 0;
+	}
+
+	/*
+	 * The fused mode relies on the cells buffer still holding the
+	 * generation shown by the back buffer.
+	 */
+	if (fused && in_place) {
+		fprintf(stderr, "--fused and --in-place are mutually "
+			"exclusive\n");
+		return 1;
+	}
+
+	if (tiled && (fused || in_place)) {
+		fprintf(stderr, "tiled layouts can not be combined with "
+			"--fused or --in-place\n");
+		return 1;
+	}
+
+	if (shards && (fused || in_place || tiled)) {
+		fprintf(stderr, "--shards can not be combined with --fused, "
+			"--in-place or tiled layouts\n");
+		return 1;
+	}
+
+	if (history_size && (fused || in_place || tiled || shards)) {
+		fprintf(stderr, "--history can not be combined with --fused, "
+			"--in-place, --shards or tiled layouts\n");
+		return 1;
+	}
+
+	if (lane >= 0 && !generations) {
+		fprintf(stderr, "--lane requires --ensemble\n");
+		return 1;
+	}
+
+	if (filename && !rule) {
+		rle_rule = rle_read_rule(filename);
+		rule = rle_rule;
+
+		/*
+		 * Only rules given with --rule are required, those of files
+		 * may have suffixes such as Golly's topologies or names that
+		 * none of the engines know.
+		 */
+		if (rule && !rle_rule_supported(rule)) {
+			fprintf(stderr, "unsupported rule in %s: %s, using "
+				"B3/S23\n", filename, rule);
+			rule = NULL;
+		}
+	}
+
+	if (rule && multistate_parse_rule(&multistate_rule, rule) == 0) {
+		if (fused || in_place || tiled || shards || history_size) {
+			fprintf(stderr, "multi-state rules can not be combined "
+				"with --fused, --in-place, --shards, --history "
+				"or tiled layouts\n");
+			return 1;
+		}
+
+		planes = multistate_planes(multistate_rule.states);
+		multistate = true;
+	} else if (rule && margolus_parse_rule(&margolus_rule, rule) == 0) {
+		if (fused || in_place || tiled || shards || history_size) {
+			fprintf(stderr, "block rules can not be combined with "
+				"--fused, --in-place, --shards, --history or "
+				"tiled layouts\n");
+			return 1;
+		}
+
+		margolus = true;
+	} else if (rule && elementary_parse_rule(&wolfram, rule) == 0) {
+		if (fused || in_place || tiled || shards || history_size ||
+		    show_hud) {
+			fprintf(stderr, "elementary rules can not be combined "
+				"with --fused, --in-place, --shards, --history, "
+				"--hud or tiled layouts\n");
+			return 1;
+		}
+
+		waterfall = true;
+	} else if (rule && rule_parse(&life_rule, rule) < 0 &&
+		   lenia_parse_rule(&lenia_rule, rule) == 0) {
+		continuous = true;
+	}
+
+	if (race_beam && (fused || shards || waterfall)) {
+		fprintf(stderr, "--race-beam can not be combined with --fused, "
+			"--shards or elementary rules\n");
+		return 1;
+	}
+
+	/* soup searches use all CPUs unless told otherwise */
+	if (!threads)
+		threads = soups ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+
+	if (soups) {
+		err = pool_create(&pool, threads);
+		if (err < 0) {
+			fprintf(stderr, "pool_create() failed: %s\n",
+				strerror(-err));
+			return 1;
+		}
+
+		if (cpus) {
+			err = pool_set_affinity(pool, cpus, num_cpus);
+			if (err < 0)
+				fprintf(stderr, "failed to set CPU affinity: "
+					"%s\n", strerror(-err));
+
+			free(cpus);
+		}
+
+		err = soup_search(pool, soups, seed);
+		if (err < 0)
+			fprintf(stderr, "soup search failed: %s\n",
+				strerror(-err));
+
+		pool_free(pool);
+
+		return err < 0 ? 1 : 0;
+	}
+
+	/* without a lane to display ensembles run headless */
+	if (generations && lane < 0) {
+		err = pool_create(&pool, threads);
+		if (err < 0) {
+			fprintf(stderr, "pool_create() failed: %s\n",
+				strerror(-err));
+			return 1;
+		}
+
+		err = ensemble_run(pool, generations, seed, &ensemble);
+		if (err < 0)
+			fprintf(stderr, "ensemble_run() failed: %s\n",
+				strerror(-err));
+		else
+			ensemble_free(ensemble);
+
+		pool_free(pool);
+
+		return err < 0 ? 1 : 0;
+	}
+
+	if (optind >= argc)
+		device = DEFAULT_DEVICE;
+	else
+		device = argv[optind];
+
+	fd = parse_fd(device);
+	if (fd < 0)
+		fd = open(device, O_RDWR);
+	else
+		lease_manager = false;
+
+	if (fd < 0) {
+		fprintf(stderr, "%s: open() failed: %m\n", device);
+		return 1;
+	}
+
+	if (lease_manager) {
+		err = lease_run(fd, argv, optind, seed, cpus, num_cpus);
+		free(cpus);
+		close(fd);
+
+		return err < 0 ? 1 : 0;
+	}
+
+	err = screen_create(&screen, fd, 0, 0);
+	if (err < 0) {
+		fprintf(stderr, "screen_create() failed: %s\n", strerror(-err));
+		return 1;
+	}
+
+	err = screen_set_swap_mode(screen, swap_mode);
+	if (err < 0) {
+		fprintf(stderr, "screen_set_swap_mode() failed: %s\n",
+			strerror(-err));
+		return 1;
+	}
+
+	if (race_beam) {
+		if (!screen->mode.clock || !screen->mode.htotal ||
+		    (screen->mode.flags & DRM_MODE_FLAG_INTERLACE)) {
+			fprintf(stderr, "--race-beam needs a progressive mode "
+				"with valid timings\n");
+			return 1;
+		}
+
+		beam_init(&beam, screen);
+	}
+
+	/*
+	 * None of these are fatal, running without them only means that
+	 * frames may occasionally be late. The scheduling policy is set
+	 * before the pool is created so that its threads inherit it.
+	 */
+	if (priority > 0) {
+		struct sched_param param = { .sched_priority = priority };
+
+		if (sched_setscheduler(0, SCHED_FIFO, &param) < 0)
+			fprintf(stderr, "failed to set real-time priority: "
+				"%m\n");
+	}
+
+	if (lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+		fprintf(stderr, "failed to lock memory: %m\n");
+
+	err = pool_create(&pool, threads);
+	if (err < 0) {
+		fprintf(stderr, "pool_create() failed: %s\n", strerror(-err));
+		return 1;
+	}
+
+	if (cpus) {
+		err = pool_set_affinity(pool, cpus, num_cpus);
+		if (err < 0)
+			fprintf(stderr, "failed to set CPU affinity: %s\n",
+				strerror(-err));
+
+		/* shards are pinned in the same way */
+		gs.cpus = cpus;
+		gs.num_cpus = num_cpus;
+	}
+
+	width = screen->width;
+	height = screen->height;
+
+	/* tiled layouts only support whole tiles */
+	if (tiled) {
+		width = width / scale / TILE_SIZE * TILE_SIZE * scale;
+		height = height / scale / TILE_SIZE * TILE_SIZE * scale;
+	}
+
+	/* blocks of 2x2 cells must tile the universe */
+	if (margolus) {
+		width = width / scale / 2 * 2 * scale;
+		height = height / scale / 2 * 2 * scale;
+	}
+
+	/* the transforms of continuous rules need power-of-two sizes */
+	if (continuous) {
+		width = lenia_size(width / scale) * scale;
+		height = lenia_size(height / scale) * scale;
+	}
+
+	grid = grid_new(width / scale, height / scale, planes, pool, numa,
+			in_place);
+	if (!grid) {
 		fprintf(stderr, "grid_new() failed\n");
 		return 1;
 	}
 
+	err = grid_draw_setup(grid, scale, screen->width, screen->height);
+	if (err < 0) {
+		fprintf(stderr, "grid_draw_setup() failed: %s\n",
+			strerror(-err));
+		return 1;
+	}
+
+	err = theme_apply(theme, screen, fade ? 0 : brightness * 0xffff / 100);
+	if (err < 0) {
+		fprintf(stderr, "gamma ramp not supported (%s), drawing theme "
+			"colours directly\n", strerror(-err));
+		grid->alive = theme_dim(theme->alive, brightness);
+		grid->dead = theme_dim(theme->dead, brightness);
+		gamma = false;
+
+		if (fade)
+			fprintf(stderr, "--fade-in needs a gamma ramp, "
+				"ignoring it\n");
+	}
+
+	if (multistate) {
+		err = multistate_create(&grid->multistate, &multistate_rule,
+					grid->width, grid->height, grid->pitch,
+					grid->plane_size);
+		if (err < 0) {
+			fprintf(stderr, "multistate_create() failed: %s\n",
+				strerror(-err));
+			return 1;
+		}
+
+		/* hexagonal Generations rules are drawn sheared */
+		if (multistate_rule.family == MULTISTATE_GENERATIONS)
+			grid->rule = &grid->multistate->rule.rule;
+
+		grid_set_palette(grid, &multistate_rule);
+	}
+
+	if (margolus) {
+		err = margolus_create(&grid->margolus, &margolus_rule,
+				      grid->width, grid->height, grid->pitch);
+		if (err < 0) {
+			fprintf(stderr, "margolus_create() failed: %s\n",
+				strerror(-err));
+			return 1;
+		}
+	}
+
+	if (show_hud) {
+		err = hud_create(&hud, screen);
+		if (err < 0) {
+			fprintf(stderr, "hud_create() failed: %s\n",
+				strerror(-err));
+			return 1;
+		}
+	}
+
 	x = grid->width / 2;
 	y = grid->height / 2;
 
-	if (filename) {
+	if (generations) {
+		err = ensemble_run(pool, generations, seed, &ensemble);
+		if (err < 0) {
+			fprintf(stderr, "ensemble_run() failed: %s\n",
+				strerror(-err));
+			return 1;
+		}
+
+		grid_from_ensemble(grid, ensemble, lane);
+		ensemble_free(ensemble);
+	} else if (filename) {
 		err = grid_load_rle(grid, filename, x, y);
 		if (err < 0) {
 			fprintf(stderr, "grid_load_rle() failed: %d\n", err);
@@ -550,25 +2389,381 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if (rule && !multistate && !margolus && !waterfall &&
+	    rule_parse(&life_rule, rule) == 0) {
+		if (tiled && !rule_is_life(&life_rule)) {
+			fprintf(stderr, "tiled layouts only support Conway's "
+				"Life\n");
+			return 1;
+		}
+
+		if (!rule_is_life(&life_rule))
+			grid->rule = &life_rule;
+	} else if (rule && !multistate && !margolus && !waterfall &&
+		   lenia_parse_rule(&lenia_rule, rule) == 0) {
+		if (fused || in_place || tiled || shards || history_size) {
+			fprintf(stderr, "continuous rules can not be combined "
+				"with --fused, --in-place, --shards, --history "
+				"or tiled layouts\n");
+			return 1;
+		}
+
+		err = lenia_create(&lenia, &lenia_rule, grid->width,
+				   grid->height);
+		if (err < 0) {
+			fprintf(stderr, "lenia_create() failed: %s\n",
+				strerror(-err));
+			return 1;
+		}
+
+		/* random cells are too fine-grained to seed these rules */
+		if (!generations && !filename && pattern == RANDOM)
+			lenia_randomize(lenia, seed);
+		else
+			lenia_from_linear(lenia, grid->parents, grid->pitch);
+
+		grid->lenia = lenia;
+		grid->draw_row = grid_draw_row_field;
+	} else if (rule && !multistate && !margolus && !waterfall) {
+		err = ltl_parse_rule(&ltl_rule, rule);
+		if (err < 0) {
+			fprintf(stderr, "unsupported rule: %s\n", rule);
+			return 1;
+		}
+
+		if (fused || in_place || tiled || shards || history_size) {
+			fprintf(stderr, "Larger-than-Life rules can not be "
+				"combined with --fused, --in-place, --shards, "
+				"--history or tiled layouts\n");
+			return 1;
+		}
+
+		err = ltl_create(&ltl, &ltl_rule, grid->width, grid->height);
+		if (err < 0) {
+			fprintf(stderr, "ltl_create() failed: %s\n",
+				strerror(-err));
+			return 1;
+		}
+
+		ltl_from_linear(ltl, grid->parents, grid->pitch);
+	}
+
+	if (waterfall) {
+		err = elementary_create(&elementary, wolfram, grid->width);
+		if (err < 0) {
+			fprintf(stderr, "elementary_create() failed: %s\n",
+				strerror(-err));
+			return 1;
+		}
+
+		/* patterns are started from their first row */
+		if (!generations && !filename && pattern == RANDOM)
+			elementary_randomize(elementary, seed);
+		else
+			elementary_from_linear(elementary, grid->parents +
+					       grid_row_offset(grid, y));
+	}
+
+	if (tiled) {
+		err = tiles_create(&tiles, grid->width, grid->height, order);
+		if (err < 0) {
+			fprintf(stderr, "tiles_create() failed: %s\n",
+				strerror(-err));
+			return 1;
+		}
+
+		tiles_from_linear(tiles, grid->parents, grid->pitch);
+	}
+
 	memset(&sa, 0, sizeof(sa));
 	sa.sa_handler = signal_handler;
 	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
 
-	while (!done) {
-		if (framerate > 0)
-			grid_tick(grid);
+	if (shards) {
+		err = grid_shards_start(&gs, grid, screen, shards);
+		if (err < 0) {
+			fprintf(stderr, "failed to start shards: %s\n",
+				strerror(-err));
+			return 1;
+		}
+	}
 
-		grid_draw(grid, screen);
-		screen_swap(screen);
-		grid_swap(grid);
-		usleep(20000);
-		gen++;
+	if (history_size) {
+		err = history_create(&history, grid->pitch, grid->height,
+				     keyframes, history_size << 20);
+		if (err < 0) {
+			fprintf(stderr, "history_create() failed: %s\n",
+				strerror(-err));
+			return 1;
+		}
+
+		grid->dirty = calloc(grid->height, sizeof(*grid->dirty));
+		if (!grid->dirty) {
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+
+		history_record(history, 0, grid->parents, NULL, NULL);
+	}
+
+	if (history || margolus)
+		terminal_setup();
+
+	if (elementary) {
+		err = waterfall_run(grid, screen, elementary, framerate);
+		if (err < 0) {
+			fprintf(stderr, "waterfall_run() failed: %s\n",
+				strerror(-err));
+			status = 1;
+		}
+
+		done = true;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &last);
+
+	redraw = 2;
+
+	clock_gettime(CLOCK_MONOTONIC, &bench_start);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &bench_cpu);
+
+	for (gen = 0, frame = 0; !done; frame++) {
+		if (gamma && frame < fade)
+			theme_apply(theme, screen, (uint64_t)(frame + 1) *
+				    brightness * 0xffff / 100 / fade);
+
+		while ((history || margolus) && (key = terminal_key()) >= 0) {
+			int steps = 0;
+
+			switch (key) {
+			case ' ':
+				/* carry on from the generation shown */
+				if (paused && history)
+					history_truncate(history, gen);
+
+				paused = !paused;
+				break;
+
+			case ',':
+				steps = -1;
+				break;
+
+			case '.':
+				steps = 1;
+				break;
+
+			case '<':
+				steps = -100;
+				break;
+
+			case '>':
+				steps = 100;
+				break;
+
+			default:
+				continue;
+			}
+
+			if ((paused || steps) && history) {
+				err = grid_rewind(grid, history, &gen, steps);
+				if (err < 0)
+					fprintf(stderr, "history_seek() failed: "
+						"%s\n", strerror(-err));
+
+				paused = true;
+			} else if (paused || steps) {
+				err = grid_step(grid, &gen, steps);
+				if (err < 0)
+					fprintf(stderr, "margolus_tick() failed: "
+						"%s\n", strerror(-err));
+
+				paused = true;
+			}
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		/*
+		 * In fused mode the framebuffers start out with unknown
+		 * contents, so both need to be drawn in full once.
+		 */
+		if (gs.shards) {
+			err = shards_barrier(gs.shards);
+			if (err < 0) {
+				status = 1;
+				break;
+			}
+		} else if (fused && framerate > 0) {
+			grid_draw(grid, screen, true, redraw > 0);
+		} else if (lenia) {
+			if (framerate > 0 && !paused)
+				lenia_tick(lenia, pool);
+
+			grid_draw_frame(grid, screen, race_beam ? &beam : NULL);
+		} else if (ltl) {
+			if (framerate > 0)
+				ltl_tick(ltl, pool);
+
+			ltl_to_linear(ltl, grid->cells, grid->pitch);
+			grid_draw_frame(grid, screen, race_beam ? &beam : NULL);
+		} else if (tiles) {
+			if (framerate > 0) {
+				tiles_tick(tiles, pool);
+				tiles_swap(tiles);
+			}
+
+			tiles_to_linear(tiles, grid->cells, grid->pitch);
+			grid_draw_frame(grid, screen, race_beam ? &beam : NULL);
+		} else {
+			if (framerate > 0 && !paused)
+				grid_tick(grid);
+
+			grid_draw_frame(grid, screen, race_beam ? &beam : NULL);
+		}
+
+		if (redraw > 0)
+			redraw--;
+
+		/* the front buffer is the other one while racing the beam */
+		if (hud)
+			hud_blit(hud, screen->fb[beam.started ?
+						 screen->current ^ 1 :
+						 screen->current]);
+
+		if (!beam.started)
+			screen_swap(screen);
+
+		beam.started = race_beam;
+
+		if (frame == 0) {
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			printf("first frame after %.1f ms, %s\n",
+			       timespec_diff_ms(&end, &startup),
+			       screen->reuse_mode ? "mode kept" :
+			       "full modeset");
+		}
+
+		if (gs.shards) {
+			gs.shards->header->current = screen->current;
+			__atomic_store_n(&gs.shards->header->done, done,
+					 __ATOMIC_RELEASE);
+
+			err = shards_barrier(gs.shards);
+			if (err < 0) {
+				status = 1;
+				break;
+			}
+		} else if (!paused) {
+			grid_swap(grid);
+
+			if (history && framerate > 0) {
+				err = history_record(history, gen + 1,
+						     grid->parents, grid->cells,
+						     grid->dirty);
+				if (err < 0)
+					fprintf(stderr, "history_record() "
+						"failed: %s\n", strerror(-err));
+			}
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		frame_time += timespec_diff_ms(&end, &start);
+		frames++;
+
+		if (!paused)
+			steps++;
+
+		/* refresh the HUD at 4 Hz */
+		if (hud && timespec_diff_ms(&end, &last) >= 250.0) {
+			double elapsed = timespec_diff_ms(&end, &last);
+			struct hud_stats stats;
+
+			stats.generation = paused ? gen : gen + 1;
+			if (gs.shards)
+				stats.population =
+					grid_shards_population(&gs, gen + 1);
+			else
+				stats.population = grid_population(grid);
+			stats.rate = steps * 1000.0 / elapsed;
+			stats.fps = frames * 1000.0 / elapsed;
+			stats.frame_time = frame_time / frames;
+			hud_update(hud, &stats);
+
+			frame_time = 0;
+			frames = 0;
+			steps = 0;
+			last = end;
+		}
+
+		/* flips and atomic commits are paced by vertical blanking */
+		if (benchmark) {
+			if (frame + 1 >= benchmark)
+				done = true;
+		} else if (swap_mode == SCREEN_SWAP_SETCRTC && !race_beam) {
+			usleep(20000);
+		}
+
+		if (!paused)
+			gen++;
+	}
+
+	if (race_beam && beam.frames) {
+		printf("raced the beam for %lu frames: %lu of %lu bands late "
+		       "(up to %.0f lines), %lu vblanks missed\n", beam.frames,
+		       beam.late, beam.bands, beam.max_lag, beam.missed);
+	}
+
+	if (benchmark && frame > 0) {
+		double elapsed, cpu;
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		elapsed = timespec_diff_ms(&end, &bench_start);
+		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
+		cpu = timespec_diff_ms(&end, &bench_cpu);
+
+		printf("%lu frames presented in %.3f s: %.2f fps, %.3f ms CPU "
+		       "per frame, %lu dropped\n", screen->presented,
+		       elapsed / 1000.0, screen->presented * 1000.0 / elapsed,
+		       cpu / frame, screen->dropped);
+	}
+
+	terminal_restore();
+
+	if (history)
+		history_free(history);
+
+	if (gs.shards) {
+		if (status)
+			fprintf(stderr, "sharded simulation failed\n");
+
+		shards_free(gs.shards);
 	}
 
+	free(cpus);
+
+	if (tiles)
+		tiles_free(tiles);
+
+	if (ltl)
+		ltl_free(ltl);
+
+	if (lenia)
+		lenia_free(lenia);
+
+	if (elementary)
+		elementary_free(elementary);
+
+	free(rle_rule);
+
 	grid_free(grid);
+	pool_free(pool);
+
+	if (hud)
+		hud_free(hud);
 
 	screen_free(screen);
 	drmClose(fd);
 
-	return 0;
+	return status;
 }
@@ -0,0 +1,84 @@
+#ifndef KMSLIFE_H
+#define KMSLIFE_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Embeddable interface to the simulation engines of kmslife. Universes are
+ * tori of width by height cells and are only accessed through an opaque
+ * handle, so that the layout of the engines can change without breaking
+ * programs built against this header. Functions that can fail return a
+ * negative error code.
+ *
+ * The rule is given in any notation that kmslife accepts: B3/S23, B2-a/S12,
+ * B2/S34H, /2/3, WireWorld, Critters, R5,C0,M1,S34..58,B34..45,NM and so
+ * on. NULL selects Conway's Life. Continuous rules (Lenia, SmoothLife) and
+ * elementary rules (W30) have no bit-plane universe, kmslife_create()
+ * fails with -ENOTSUP for them.
+ *
+ * Cells are stored as bit planes. Plane p holds bit p of the state of each
+ * cell, in rows of kmslife_pitch() bytes with the cell at x in bit x % 8 of
+ * byte x / 8. kmslife_row() gives access to the rows without any copies;
+ * writes through it take effect with the next step.
+ *
+ * Only the kmslife_*() functions are exported from the shared library, the
+ * engines behind them are private. Use pkg-config to build against it:
+ * "pkg-config --cflags --libs kmslife" (add --static for -lm -lpthread).
+ */
+
+#define KMSLIFE_API_VERSION 1
+
+#if defined(__GNUC__) && __GNUC__ >= 4
+#define KMSLIFE_EXPORT __attribute__((visibility("default")))
+#else
+#define KMSLIFE_EXPORT
+#endif
+
+/* update the single bitmap in place, halving the memory needed */
+#define KMSLIFE_IN_PLACE (1 << 0)
+/* run Conway's Life on tiles of 64x64 cells (sizes must be multiples) */
+#define KMSLIFE_TILES (1 << 1)
+/* as KMSLIFE_TILES, with the tiles stored in Morton order */
+#define KMSLIFE_MORTON (1 << 2)
+
+struct kmslife;
+
+KMSLIFE_EXPORT int kmslife_create(struct kmslife **lifep, unsigned int width,
+				  unsigned int height, const char *rule,
+				  unsigned int threads, unsigned int flags);
+KMSLIFE_EXPORT int kmslife_free(struct kmslife *life);
+
+KMSLIFE_EXPORT unsigned int kmslife_width(struct kmslife *life);
+KMSLIFE_EXPORT unsigned int kmslife_height(struct kmslife *life);
+KMSLIFE_EXPORT unsigned int kmslife_states(struct kmslife *life);
+KMSLIFE_EXPORT unsigned int kmslife_planes(struct kmslife *life);
+KMSLIFE_EXPORT size_t kmslife_pitch(struct kmslife *life);
+KMSLIFE_EXPORT unsigned long kmslife_generation(struct kmslife *life);
+
+KMSLIFE_EXPORT int kmslife_step(struct kmslife *life,
+				unsigned long generations);
+KMSLIFE_EXPORT unsigned long kmslife_population(struct kmslife *life);
+KMSLIFE_EXPORT int kmslife_randomize(struct kmslife *life, unsigned int seed);
+
+KMSLIFE_EXPORT int kmslife_set_rect(struct kmslife *life, unsigned int x,
+				    unsigned int y, unsigned int width,
+				    unsigned int height, const uint8_t *states,
+				    size_t stride);
+KMSLIFE_EXPORT int kmslife_get_rect(struct kmslife *life, unsigned int x,
+				    unsigned int y, unsigned int width,
+				    unsigned int height, uint8_t *states,
+				    size_t stride);
+
+KMSLIFE_EXPORT void *kmslife_row(struct kmslife *life, unsigned int plane,
+				 unsigned int y);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KMSLIFE_H */
@@ -0,0 +1,282 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+#include "drm-utils.h"
+#include "lease.h"
+
+/*
+ * Find a plane of the given type that can be used with the CRTC at index
+ * pipe and that has not been leased yet.
+ */
+static uint32_t lease_find_plane(int fd, drmModePlaneRes *res, bool *used,
+				 unsigned int pipe, int type)
+{
+	drmModePlane *plane;
+	uint32_t i, id = 0;
+	uint64_t value;
+
+	for (i = 0; i < res->count_planes && !id; i++) {
+		if (used[i])
+			continue;
+
+		plane = drmModeGetPlane(fd, res->planes[i]);
+		if (!plane)
+			continue;
+
+		if ((plane->possible_crtcs & (1u << pipe)) &&
+		    object_get_property(fd, plane->plane_id,
+					DRM_MODE_OBJECT_PLANE, "type",
+					&value) && value == type) {
+			id = plane->plane_id;
+			used[i] = true;
+		}
+
+		drmModeFreePlane(plane);
+	}
+
+	return id;
+}
+
+static int lease_manager_add(struct lease_manager *manager,
+			     drmModeRes *res, drmModePlaneRes *planes,
+			     bool *used, drmModeConnector *connector,
+			     uint32_t *busy)
+{
+	struct lease *lease, *leases;
+	uint32_t primary, overlay;
+	int pipe;
+
+	pipe = connector_find_crtc(manager->fd, res, connector, *busy);
+	if (pipe < 0)
+		return pipe;
+
+	/* legacy modesets of the lessee go through the primary plane */
+	primary = lease_find_plane(manager->fd, planes, used, pipe,
+				   DRM_PLANE_TYPE_PRIMARY);
+	if (!primary)
+		return -ENODEV;
+
+	overlay = lease_find_plane(manager->fd, planes, used, pipe,
+				   DRM_PLANE_TYPE_OVERLAY);
+
+	leases = realloc(manager->leases,
+			 (manager->count + 1) * sizeof(*leases));
+	if (!leases)
+		return -ENOMEM;
+
+	manager->leases = leases;
+	lease = &leases[manager->count];
+	memset(lease, 0, sizeof(*lease));
+
+	lease->objects[lease->num_objects++] = connector->connector_id;
+	lease->objects[lease->num_objects++] = res->crtcs[pipe];
+	lease->objects[lease->num_objects++] = primary;
+
+	if (overlay)
+		lease->objects[lease->num_objects++] = overlay;
+
+	lease->fd = drmModeCreateLease(manager->fd, lease->objects,
+				       lease->num_objects, O_CLOEXEC,
+				       &lease->lessee);
+	if (lease->fd < 0)
+		return -errno;
+
+	*busy |= 1u << pipe;
+	manager->count++;
+
+	return 0;
+}
+
+/*
+ * Creates one lease per connected output. Outputs for which no CRTC or
+ * primary plane is left are skipped. Fails with -ENODEV if nothing could
+ * be leased.
+ */
+int lease_manager_create(struct lease_manager **managerp, int fd)
+{
+	struct lease_manager *manager;
+	drmModePlaneRes *planes;
+	drmModeConnector *conn;
+	uint32_t busy = 0, i;
+	drmModeRes *res;
+	bool *used;
+	int err;
+
+	err = drmSetMaster(fd);
+	if (err < 0)
+		return -errno;
+
+	/* primary planes are only listed with universal planes enabled */
+	err = drmSetClientCap(fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+	if (err < 0)
+		return -errno;
+
+	manager = calloc(1, sizeof(*manager));
+	if (!manager)
+		return -ENOMEM;
+
+	manager->fd = fd;
+
+	res = drmModeGetResources(fd);
+	planes = drmModeGetPlaneResources(fd);
+	if (!res || !planes) {
+		err = -ENODEV;
+		goto out;
+	}
+
+	used = calloc(planes->count_planes, sizeof(*used));
+	if (!used) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < res->count_connectors; i++) {
+		conn = drmModeGetConnector(fd, res->connectors[i]);
+		if (!conn)
+			continue;
+
+		if (conn->connection == DRM_MODE_CONNECTED &&
+		    conn->count_modes) {
+			err = lease_manager_add(manager, res, planes, used,
+						conn, &busy);
+			if (err < 0)
+				fprintf(stderr, "failed to lease connector "
+					"%u: %s\n", conn->connector_id,
+					strerror(-err));
+		}
+
+		drmModeFreeConnector(conn);
+	}
+
+	free(used);
+	err = manager->count ? 0 : -ENODEV;
+
+out:
+	if (planes)
+		drmModeFreePlaneResources(planes);
+
+	if (res)
+		drmModeFreeResources(res);
+
+	if (err < 0) {
+		lease_manager_free(manager);
+		return err;
+	}
+
+	*managerp = manager;
+
+	return 0;
+}
+
+/*
+ * Revokes all leases. Instances that are still running lose access to
+ * their outputs. The device itself is left open and master is kept.
+ */
+int lease_manager_free(struct lease_manager *manager)
+{
+	unsigned int i;
+
+	if (!manager)
+		return -EINVAL;
+
+	for (i = 0; i < manager->count; i++) {
+		if (manager->leases[i].fd >= 0)
+			close(manager->leases[i].fd);
+
+		drmModeRevokeLease(manager->fd, manager->leases[i].lessee);
+	}
+
+	free(manager->leases);
+	free(manager);
+
+	return 0;
+}
+
+/*
+ * Runs a new instance of this program with the given arguments and hands
+ * it the lease at the given index. The lease file descriptor is the only
+ * one of the device that the instance inherits, and the instance is
+ * interrupted if the manager goes away, since that revokes its lease.
+ */
+int lease_manager_spawn(struct lease_manager *manager, unsigned int index,
+			char *const argv[])
+{
+	pid_t parent = getpid(), pid;
+	struct lease *lease;
+
+	if (index >= manager->count)
+		return -EINVAL;
+
+	lease = &manager->leases[index];
+
+	pid = fork();
+	if (pid < 0)
+		return -errno;
+
+	if (pid == 0) {
+		/* the manager may have died before the signal was set up */
+		if (prctl(PR_SET_PDEATHSIG, SIGINT) < 0 ||
+		    getppid() != parent)
+			_exit(1);
+
+		close(manager->fd);
+
+		if (fcntl(lease->fd, F_SETFD, 0) < 0)
+			_exit(1);
+
+		execv("/proc/self/exe", argv);
+		fprintf(stderr, "lease %u: execv() failed: %m\n", index);
+		_exit(1);
+	}
+
+	close(lease->fd);
+	lease->fd = -1;
+	lease->pid = pid;
+
+	return 0;
+}
+
+/* Waits for all instances and returns the number of those that failed. */
+unsigned int lease_manager_wait(struct lease_manager *manager)
+{
+	unsigned int failed = 0, i;
+	struct lease *lease;
+	int status;
+
+	for (i = 0; i < manager->count; i++) {
+		lease = &manager->leases[i];
+
+		if (lease->pid <= 0)
+			continue;
+
+		while (waitpid(lease->pid, &status, 0) < 0) {
+			if (errno != EINTR) {
+				status = W_EXITCODE(1, 0);
+				break;
+			}
+		}
+
+		if (WIFSIGNALED(status)) {
+			fprintf(stderr, "lease %u: killed by signal %d\n", i,
+				WTERMSIG(status));
+			failed++;
+		} else if (WEXITSTATUS(status)) {
+			fprintf(stderr, "lease %u: exited with status %d\n",
+				i, WEXITSTATUS(status));
+			failed++;
+		}
+
+		lease->pid = 0;
+	}
+
+	return failed;
+}
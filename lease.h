@@ -0,0 +1,38 @@
+#ifndef LEASE_H
+#define LEASE_H 1
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define LEASE_MAX_OBJECTS 4
+
+/*
+ * A connector together with a CRTC to drive it, the primary plane of that
+ * CRTC and, if there is one to spare, an overlay plane for the HUD.
+ */
+struct lease {
+	uint32_t objects[LEASE_MAX_OBJECTS];
+	unsigned int num_objects;
+	uint32_t lessee;
+	int fd;
+	pid_t pid;
+};
+
+/*
+ * Holds master on a device and leases each of its connected outputs to a
+ * separate instance, so that every output can run its own universe in its
+ * own process.
+ */
+struct lease_manager {
+	struct lease *leases;
+	unsigned int count;
+	int fd;
+};
+
+int lease_manager_create(struct lease_manager **managerp, int fd);
+int lease_manager_free(struct lease_manager *manager);
+int lease_manager_spawn(struct lease_manager *manager, unsigned int index,
+			char *const argv[]);
+unsigned int lease_manager_wait(struct lease_manager *manager);
+
+#endif /* LEASE_H */
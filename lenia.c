@@ -0,0 +1,549 @@
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "lenia.h"
+
+#define LENIA_MAX_RADIUS 256
+
+/* widths of the SmoothLife sigmoids for the ring and disk fillings */
+#define SMOOTHLIFE_ALPHA_N 0.028f
+#define SMOOTHLIFE_ALPHA_M 0.147f
+
+#define LENIA_VECTOR 8
+
+typedef float lenia_vec __attribute__((vector_size(LENIA_VECTOR * sizeof(float))));
+typedef int32_t lenia_ivec __attribute__((vector_size(LENIA_VECTOR * sizeof(int32_t))));
+typedef uint32_t lenia_uvec __attribute__((vector_size(LENIA_VECTOR * sizeof(uint32_t))));
+
+static int lenia_parse_float(const char *ptr, float *value)
+{
+	char *end;
+
+	*value = strtof(ptr, &end);
+	if (end == ptr || *end != '\0' || !isfinite(*value))
+		return -EINVAL;
+
+	return 0;
+}
+
+static int lenia_parse_range(char *ptr, float *min, float *max)
+{
+	char *dots = strstr(ptr, "..");
+	int err;
+
+	if (!dots)
+		return -EINVAL;
+
+	*dots = '\0';
+
+	err = lenia_parse_float(ptr, min);
+	if (err < 0)
+		return err;
+
+	err = lenia_parse_float(dots + 2, max);
+	if (err < 0)
+		return err;
+
+	return *min <= *max ? 0 : -EINVAL;
+}
+
+/*
+ * Parses "Lenia" and "SmoothLife", each optionally followed by a comma
+ * separated list of parameters.
+ */
+int lenia_parse_rule(struct lenia_rule *rule, const char *string)
+{
+	char *copy, *token, *save, *end;
+	unsigned long value;
+	float steps;
+	int err = 0;
+
+	memset(rule, 0, sizeof(*rule));
+
+	if (strncasecmp(string, "Lenia", 5) == 0 &&
+	    (string[5] == '\0' || string[5] == ',')) {
+		rule->family = LENIA;
+		rule->radius = 13;
+		rule->dt = 0.1f;
+		rule->mu = 0.15f;
+		rule->sigma = 0.015f;
+	} else if (strncasecmp(string, "SmoothLife", 10) == 0 &&
+		   (string[10] == '\0' || string[10] == ',')) {
+		rule->family = SMOOTHLIFE;
+		rule->radius = 12;
+		rule->dt = 1.0f;
+		rule->birth_min = 0.278f;
+		rule->birth_max = 0.365f;
+		rule->survive_min = 0.267f;
+		rule->survive_max = 0.445f;
+	} else {
+		return -EINVAL;
+	}
+
+	copy = strdup(strchr(string, ',') ? strchr(string, ',') + 1 : "");
+	if (!copy)
+		return -ENOMEM;
+
+	for (token = strtok_r(copy, ",", &save); token && !err;
+	     token = strtok_r(NULL, ",", &save)) {
+		switch (toupper(token[0])) {
+		case 'R':
+			value = strtoul(token + 1, &end, 10);
+			if (end == token + 1 || *end || !value ||
+			    value > LENIA_MAX_RADIUS)
+				err = -EINVAL;
+
+			rule->radius = value;
+			break;
+
+		case 'T':
+			err = lenia_parse_float(token + 1, &steps);
+			if (!err && steps < 1.0f)
+				err = -EINVAL;
+
+			rule->dt = 1.0f / steps;
+			break;
+
+		case 'M':
+			if (rule->family != LENIA)
+				err = -EINVAL;
+			else
+				err = lenia_parse_float(token + 1, &rule->mu);
+			break;
+
+		case 'S':
+			if (rule->family == LENIA) {
+				err = lenia_parse_float(token + 1, &rule->sigma);
+				if (!err && rule->sigma <= 0.0f)
+					err = -EINVAL;
+			} else {
+				err = lenia_parse_range(token + 1,
+							&rule->survive_min,
+							&rule->survive_max);
+			}
+			break;
+
+		case 'B':
+			if (rule->family != SMOOTHLIFE)
+				err = -EINVAL;
+			else
+				err = lenia_parse_range(token + 1,
+							&rule->birth_min,
+							&rule->birth_max);
+			break;
+
+		default:
+			err = -EINVAL;
+			break;
+		}
+	}
+
+	free(copy);
+
+	return err;
+}
+
+/* smooth shell of the Lenia kernel, peaking halfway out */
+static double lenia_shell(double r)
+{
+	if (r <= 0.0 || r >= 1.0)
+		return 0.0;
+
+	return exp(4.0 - 1.0 / (r * (1.0 - r)));
+}
+
+/* anti-aliased disk, the ring being the difference of two of them */
+static double lenia_disk(double r, double radius)
+{
+	double weight = radius + 0.5 - r;
+
+	return weight < 0.0 ? 0.0 : weight > 1.0 ? 1.0 : weight;
+}
+
+/*
+ * Samples a kernel, centred on cell 0 and wrapping around the edges, and
+ * stores its spectrum normalised such that the convolution computes the
+ * weighted average of the neighbourhood.
+ */
+static void lenia_kernel(struct lenia *lenia, struct pool *pool, bool disk,
+			 float *re, float *im)
+{
+	int radius = lenia->rule.radius, x, y;
+	double inner = radius / 3.0, r, weight, sum = 0.0, scale;
+	float *field = lenia->potential;
+	size_t i;
+
+	memset(field, 0, (size_t)lenia->columns * lenia->rows * sizeof(float));
+
+	for (y = -radius; y <= radius; y++) {
+		for (x = -radius; x <= radius; x++) {
+			r = sqrt(x * x + y * y);
+
+			if (lenia->rule.family == LENIA)
+				weight = lenia_shell(r / radius);
+			else if (disk)
+				weight = lenia_disk(r, inner);
+			else
+				weight = lenia_disk(r, radius) *
+					 (1.0 - lenia_disk(r, inner));
+
+			field[(size_t)((y + lenia->rows) % lenia->rows) *
+			      lenia->columns +
+			      (x + lenia->columns) % lenia->columns] = weight;
+			sum += weight;
+		}
+	}
+
+	fft2_forward(lenia->fft, pool, field, re, im);
+
+	/* the inverse transform is scaled by the number of cells / 2 */
+	scale = 2.0 / (sum * lenia->columns * lenia->rows);
+
+	for (i = 0; i < (size_t)lenia->columns * lenia->fft->stride; i++) {
+		re[i] *= scale;
+		im[i] *= scale;
+	}
+}
+
+/*
+ * Returns the largest size of a universe that fits into size cells, or 0 if
+ * there is none.
+ */
+unsigned int lenia_size(unsigned int size)
+{
+	unsigned int value = FFT_VECTOR;
+
+	if (size < value)
+		return 0;
+
+	while (value <= size / 2)
+		value *= 2;
+
+	return value;
+}
+
+int lenia_create(struct lenia **leniap, const struct lenia_rule *rule,
+		 unsigned int width, unsigned int height)
+{
+	struct lenia *lenia;
+	struct pool *pool;
+	size_t cells, bins;
+	int err;
+
+	if (!rule->radius || lenia_size(width) != width ||
+	    lenia_size(height) != height || width < 2 * rule->radius + 1 ||
+	    height < 2 * rule->radius + 1)
+		return -EINVAL;
+
+	lenia = calloc(1, sizeof(*lenia));
+	if (!lenia)
+		return -ENOMEM;
+
+	lenia->rule = *rule;
+	lenia->width = width;
+	lenia->height = height;
+	lenia->columns = width;
+	lenia->rows = height;
+
+	err = fft2_create(&lenia->fft, lenia->columns, lenia->rows);
+	if (err < 0) {
+		lenia_free(lenia);
+		return err;
+	}
+
+	cells = (size_t)lenia->columns * lenia->rows;
+	bins = (size_t)lenia->columns * lenia->fft->stride;
+
+	lenia->field = fft_alloc(cells);
+	lenia->potential = fft_alloc(cells);
+	lenia->re = fft_alloc(bins);
+	lenia->im = fft_alloc(bins);
+	lenia->kernel_re = fft_alloc(bins);
+	lenia->kernel_im = fft_alloc(bins);
+
+	if (!lenia->field || !lenia->potential || !lenia->re || !lenia->im ||
+	    !lenia->kernel_re || !lenia->kernel_im) {
+		lenia_free(lenia);
+		return -ENOMEM;
+	}
+
+	if (rule->family == SMOOTHLIFE) {
+		lenia->filling = fft_alloc(cells);
+		lenia->scratch_re = fft_alloc(bins);
+		lenia->scratch_im = fft_alloc(bins);
+		lenia->disk_re = fft_alloc(bins);
+		lenia->disk_im = fft_alloc(bins);
+
+		if (!lenia->filling || !lenia->scratch_re ||
+		    !lenia->scratch_im || !lenia->disk_re || !lenia->disk_im) {
+			lenia_free(lenia);
+			return -ENOMEM;
+		}
+	}
+
+	/* the kernels are transformed once, on a private single thread */
+	err = pool_create(&pool, 1);
+	if (err < 0) {
+		lenia_free(lenia);
+		return err;
+	}
+
+	lenia_kernel(lenia, pool, false, lenia->kernel_re, lenia->kernel_im);
+
+	if (rule->family == SMOOTHLIFE)
+		lenia_kernel(lenia, pool, true, lenia->disk_re, lenia->disk_im);
+
+	pool_free(pool);
+
+	*leniap = lenia;
+
+	return 0;
+}
+
+int lenia_free(struct lenia *lenia)
+{
+	if (!lenia)
+		return -EINVAL;
+
+	free(lenia->disk_im);
+	free(lenia->disk_re);
+	free(lenia->scratch_im);
+	free(lenia->scratch_re);
+	free(lenia->filling);
+	free(lenia->kernel_im);
+	free(lenia->kernel_re);
+	free(lenia->im);
+	free(lenia->re);
+	free(lenia->potential);
+	free(lenia->field);
+
+	if (lenia->fft)
+		fft2_free(lenia->fft);
+
+	free(lenia);
+
+	return 0;
+}
+
+void lenia_from_linear(struct lenia *lenia, const void *src,
+		       unsigned int pitch)
+{
+	const uint8_t *row;
+	unsigned int x, y;
+
+	for (y = 0; y < lenia->height; y++) {
+		row = (const uint8_t *)src + (size_t)y * pitch;
+
+		for (x = 0; x < lenia->width; x++)
+			lenia->field[(size_t)y * lenia->columns + x] =
+				(row[x / 8] >> (x % 8)) & 1;
+	}
+}
+
+/*
+ * Continuous rules need smooth patches of intermediate values to get
+ * going, so random squares about the size of the kernel are scattered
+ * over the visible part of the universe.
+ */
+void lenia_randomize(struct lenia *lenia, unsigned int seed)
+{
+	unsigned int size = 2 * lenia->rule.radius, count, i, x, y, x0, y0;
+
+	if (size > lenia->width)
+		size = lenia->width;
+
+	if (size > lenia->height)
+		size = lenia->height;
+
+	count = lenia->width * lenia->height / (16 * size * size) + 1;
+
+	for (i = 0; i < count; i++) {
+		x0 = rand_r(&seed) % (lenia->width - size + 1);
+		y0 = rand_r(&seed) % (lenia->height - size + 1);
+
+		for (y = y0; y < y0 + size; y++)
+			for (x = x0; x < x0 + size; x++)
+				lenia->field[(size_t)y * lenia->columns + x] =
+					(float)rand_r(&seed) / RAND_MAX;
+	}
+}
+
+static void lenia_band(unsigned int size, unsigned int index,
+		       unsigned int count, unsigned int *start,
+		       unsigned int *end)
+{
+	unsigned int rows = (size + count - 1) / count;
+
+	*start = index * rows;
+	*end = *start + rows;
+
+	if (*start > size)
+		*start = size;
+
+	if (*end > size)
+		*end = size;
+}
+
+/*
+ * Multiplies the spectrum of the field with those of the kernels. For
+ * SmoothLife the product with the disk goes into the scratch spectrum
+ * since the inverse transforms consume their input.
+ */
+static void lenia_multiply_band(void *data, unsigned int index,
+				unsigned int count)
+{
+	struct lenia *lenia = data;
+	size_t stride = lenia->fft->stride, i;
+	unsigned int start, end;
+	float re, im;
+
+	lenia_band(lenia->columns, index, count, &start, &end);
+
+	for (i = start * stride; i < end * stride; i++) {
+		re = lenia->re[i];
+		im = lenia->im[i];
+
+		if (lenia->rule.family == SMOOTHLIFE) {
+			lenia->scratch_re[i] = re * lenia->disk_re[i] -
+					       im * lenia->disk_im[i];
+			lenia->scratch_im[i] = re * lenia->disk_im[i] +
+					       im * lenia->disk_re[i];
+		}
+
+		lenia->re[i] = re * lenia->kernel_re[i] -
+			       im * lenia->kernel_im[i];
+		lenia->im[i] = re * lenia->kernel_im[i] +
+			       im * lenia->kernel_re[i];
+	}
+}
+
+static inline float smoothlife_sigmoid(float x, float a, float alpha)
+{
+	return 1.0f / (1.0f + expf(-(x - a) * 4.0f / alpha));
+}
+
+/*
+ * Cells whose disk is mostly filled are alive and live cells survive if
+ * the filling of their ring is within the survival interval, dead ones are
+ * born within the birth interval. Sigmoids smooth out all of the steps.
+ */
+static inline float smoothlife_transition(const struct lenia_rule *rule,
+					  float n, float m)
+{
+	float alive = smoothlife_sigmoid(m, 0.5f, SMOOTHLIFE_ALPHA_M);
+	float min = rule->birth_min * (1.0f - alive) +
+		    rule->survive_min * alive;
+	float max = rule->birth_max * (1.0f - alive) +
+		    rule->survive_max * alive;
+
+	return smoothlife_sigmoid(n, min, SMOOTHLIFE_ALPHA_N) *
+	       (1.0f - smoothlife_sigmoid(n, max, SMOOTHLIFE_ALPHA_N));
+}
+
+static void lenia_update_band(void *data, unsigned int index,
+			      unsigned int count)
+{
+	struct lenia *lenia = data;
+	const struct lenia_rule *rule = &lenia->rule;
+	float scale = 1.0f / (2.0f * rule->sigma * rule->sigma);
+	unsigned int start, end;
+	float value, u, s;
+	size_t i;
+
+	lenia_band(lenia->rows, index, count, &start, &end);
+
+	for (i = (size_t)start * lenia->columns;
+	     i < (size_t)end * lenia->columns; i++) {
+		value = lenia->field[i];
+		u = lenia->potential[i];
+
+		if (rule->family == LENIA) {
+			value += rule->dt *
+				 (2.0f * expf(-(u - rule->mu) * (u - rule->mu) *
+					      scale) - 1.0f);
+			value = value < 0.0f ? 0.0f : value > 1.0f ? 1.0f : value;
+		} else {
+			s = smoothlife_transition(rule, u, lenia->filling[i]);
+			value += rule->dt * (s - value);
+		}
+
+		lenia->field[i] = value;
+	}
+}
+
+void lenia_tick(struct lenia *lenia, struct pool *pool)
+{
+	fft2_forward(lenia->fft, pool, lenia->field, lenia->re, lenia->im);
+	pool_run(pool, lenia_multiply_band, lenia);
+	fft2_inverse(lenia->fft, pool, lenia->re, lenia->im, lenia->potential);
+
+	if (lenia->rule.family == SMOOTHLIFE)
+		fft2_inverse(lenia->fft, pool, lenia->scratch_re,
+			     lenia->scratch_im, lenia->filling);
+
+	pool_run(pool, lenia_update_band, lenia);
+}
+
+/* number of visible cells that are more alive than dead */
+unsigned long lenia_population(struct lenia *lenia)
+{
+	unsigned long population = 0;
+	unsigned int x, y;
+
+	for (y = 0; y < lenia->height; y++)
+		for (x = 0; x < lenia->width; x++)
+			if (lenia->field[(size_t)y * lenia->columns + x] >= 0.5f)
+				population++;
+
+	return population;
+}
+
+/*
+ * Maps a row of values, which are always between 0 and 1, to colours
+ * between the dead and alive ones, channel by channel for LENIA_VECTOR
+ * cells at a time. Rows are padded to a multiple of the vector size.
+ */
+void lenia_draw_row(const float *row, unsigned int width, unsigned int scale,
+		    uint32_t dead, uint32_t alive, uint32_t *ptr)
+{
+	lenia_vec base[4], range[4], value;
+	uint32_t colors[LENIA_VECTOR];
+	unsigned int x, i, j, n, c;
+	lenia_uvec color;
+	float from, to;
+
+	for (c = 0; c < 4; c++) {
+		from = (dead >> (8 * c)) & 0xff;
+		to = (alive >> (8 * c)) & 0xff;
+
+		/* rounds to the nearest value on conversion */
+		base[c] = (lenia_vec){ 0 } + from + 0.5f;
+		range[c] = (lenia_vec){ 0 } + (to - from);
+	}
+
+	for (x = 0; x < width; x += LENIA_VECTOR) {
+		memcpy(&value, row + x, sizeof(value));
+
+		color = (lenia_uvec){ 0 };
+
+		for (c = 0; c < 4; c++)
+			color |= (lenia_uvec)__builtin_convertvector(base[c] +
+					value * range[c], lenia_ivec) << (8 * c);
+
+		memcpy(colors, &color, sizeof(colors));
+		n = width - x < LENIA_VECTOR ? width - x : LENIA_VECTOR;
+
+		if (scale == 1) {
+			memcpy(ptr + x, colors, n * sizeof(uint32_t));
+			continue;
+		}
+
+		for (j = 0; j < n; j++)
+			for (i = 0; i < scale; i++)
+				ptr[(x + j) * scale + i] = colors[j];
+	}
+}
@@ -0,0 +1,93 @@
+#ifndef LENIA_H
+#define LENIA_H 1
+
+#include <stdint.h>
+
+#include "fft.h"
+#include "pool.h"
+
+enum lenia_family {
+	LENIA,
+	SMOOTHLIFE,
+};
+
+/*
+ * Continuous rules such as "Lenia,R13,T10,M0.15,S0.015" (Orbium): kernel
+ * radius, time steps per unit of time and the centre and width of the
+ * growth function, or "SmoothLife,R12,T1,B0.278..0.365,S0.267..0.445":
+ * outer radius, time steps and the birth and survival intervals of the
+ * filling of the ring around the disk of each cell. Omitted parameters
+ * default to the values above.
+ */
+struct lenia_rule {
+	enum lenia_family family;
+	unsigned int radius;
+	float dt;
+
+	/* Lenia growth function */
+	float mu;
+	float sigma;
+
+	/* SmoothLife transition */
+	float birth_min;
+	float birth_max;
+	float survive_min;
+	float survive_max;
+};
+
+/*
+ * Continuous universe of values between 0 and 1, stored as floats. The
+ * convolutions with the kernels are computed as products of spectra, so
+ * the cost per step grows with the size of the universe as N log N and
+ * does not depend on the radius. The transforms need power-of-two sizes,
+ * so the universe is rounded down to one of those with lenia_size() and
+ * shown centred on the screen, which keeps all of it visible and its edges
+ * wrapping around.
+ */
+struct lenia {
+	struct lenia_rule rule;
+	unsigned int width;
+	unsigned int height;
+
+	/* size of the transforms, the same as that of the universe */
+	unsigned int columns;
+	unsigned int rows;
+	float *field;
+
+	struct fft2 *fft;
+	float *re;
+	float *im;
+	float *scratch_re;
+	float *scratch_im;
+
+	/* spectra of the kernels: the shell or ring and the disk */
+	float *kernel_re;
+	float *kernel_im;
+	float *disk_re;
+	float *disk_im;
+
+	/* convolutions of the field with the kernels */
+	float *potential;
+	float *filling;
+};
+
+int lenia_parse_rule(struct lenia_rule *rule, const char *string);
+unsigned int lenia_size(unsigned int size);
+int lenia_create(struct lenia **leniap, const struct lenia_rule *rule,
+		 unsigned int width, unsigned int height);
+int lenia_free(struct lenia *lenia);
+void lenia_from_linear(struct lenia *lenia, const void *src,
+		       unsigned int pitch);
+void lenia_randomize(struct lenia *lenia, unsigned int seed);
+void lenia_tick(struct lenia *lenia, struct pool *pool);
+unsigned long lenia_population(struct lenia *lenia);
+
+static inline const float *lenia_row(struct lenia *lenia, unsigned int y)
+{
+	return lenia->field + (size_t)y * lenia->columns;
+}
+
+void lenia_draw_row(const float *row, unsigned int width, unsigned int scale,
+		    uint32_t dead, uint32_t alive, uint32_t *ptr);
+
+#endif /* LENIA_H */
@@ -0,0 +1,159 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kmslife.h"
+
+#define WIDTH 128
+#define HEIGHT 128
+#define STEPS 7
+#define ROUNDS 5
+
+/* one generation of Conway's Life on a torus, one byte per cell */
+static void reference_tick(uint8_t *cells, unsigned int width,
+			   unsigned int height)
+{
+	unsigned int x, y, count;
+	uint8_t *next;
+	int dx, dy;
+
+	next = malloc(width * height);
+	if (!next)
+		abort();
+
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			count = 0;
+
+			for (dy = -1; dy <= 1; dy++) {
+				unsigned int row = (y + dy + height) % height;
+
+				for (dx = -1; dx <= 1; dx++)
+					if (dx || dy)
+						count += cells[row * width +
+							       (x + dx + width) % width];
+			}
+
+			next[y * width + x] = count == 3 ||
+					      (count == 2 && cells[y * width + x]);
+		}
+	}
+
+	memcpy(cells, next, width * height);
+	free(next);
+}
+
+/* compares a layout and thread count against the reference */
+static int check_life(const char *name, unsigned int flags,
+		      unsigned int threads)
+{
+	static uint8_t expected[WIDTH * HEIGHT], cells[WIDTH * HEIGHT];
+	unsigned long population = 0;
+	struct kmslife *life;
+	unsigned int i, j;
+	uint8_t *row;
+	int err;
+
+	err = kmslife_create(&life, WIDTH, HEIGHT, NULL, threads, flags);
+	if (err < 0) {
+		fprintf(stderr, "%s: kmslife_create() failed: %d\n", name, err);
+		return 1;
+	}
+
+	kmslife_randomize(life, 42);
+	kmslife_get_rect(life, 0, 0, WIDTH, HEIGHT, expected, WIDTH);
+
+	for (i = 0; i < ROUNDS; i++) {
+		kmslife_step(life, STEPS);
+
+		for (j = 0; j < STEPS; j++)
+			reference_tick(expected, WIDTH, HEIGHT);
+
+		kmslife_get_rect(life, 0, 0, WIDTH, HEIGHT, cells, WIDTH);
+
+		if (memcmp(cells, expected, sizeof(cells)) != 0) {
+			fprintf(stderr, "%s: generation %lu differs\n", name,
+				kmslife_generation(life));
+			kmslife_free(life);
+			return 1;
+		}
+	}
+
+	for (i = 0; i < WIDTH * HEIGHT; i++)
+		population += expected[i];
+
+	if (kmslife_population(life) != population) {
+		fprintf(stderr, "%s: population %lu, expected %lu\n", name,
+			kmslife_population(life), population);
+		kmslife_free(life);
+		return 1;
+	}
+
+	/* writes through the row pointers show up in the next read */
+	row = kmslife_row(life, 0, 3);
+	memset(row, 0, kmslife_pitch(life));
+	kmslife_get_rect(life, 0, 3, WIDTH, 1, cells, WIDTH);
+
+	for (i = 0; i < WIDTH; i++) {
+		if (cells[i]) {
+			fprintf(stderr, "%s: row write not visible\n", name);
+			kmslife_free(life);
+			return 1;
+		}
+	}
+
+	kmslife_free(life);
+	return 0;
+}
+
+/* rules of the other engines are accepted, continuous ones are not */
+static int check_rule(const char *rule, int expected)
+{
+	struct kmslife *life;
+	int err;
+
+	err = kmslife_create(&life, 64, 64, rule, 1, 0);
+	if (err != expected) {
+		fprintf(stderr, "%s: kmslife_create() returned %d, expected "
+			"%d\n", rule, err, expected);
+		if (err == 0)
+			kmslife_free(life);
+
+		return 1;
+	}
+
+	if (err == 0) {
+		err = kmslife_step(life, 10);
+		kmslife_free(life);
+
+		if (err < 0) {
+			fprintf(stderr, "%s: kmslife_step() failed: %d\n", rule,
+				err);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int main(void)
+{
+	unsigned int failed = 0;
+
+	failed += check_life("linear", 0, 1);
+	failed += check_life("linear, 3 threads", 0, 3);
+	failed += check_life("in-place", KMSLIFE_IN_PLACE, 2);
+	failed += check_life("tiles", KMSLIFE_TILES, 2);
+	failed += check_life("morton", KMSLIFE_MORTON, 1);
+
+	failed += check_rule("B2/S34H", 0);
+	failed += check_rule("/2/3", 0);
+	failed += check_rule("WireWorld", 0);
+	failed += check_rule("Critters", 0);
+	failed += check_rule("R2,C3,M1,S3..5,B3..4,NM", 0);
+	failed += check_rule("Lenia", -ENOTSUP);
+	failed += check_rule("W30", -ENOTSUP);
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,359 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "grid.h"
+#include "kmslife.h"
+#include "ltl.h"
+#include "margolus.h"
+#include "multistate.h"
+#include "pool.h"
+#include "rule.h"
+#include "tile.h"
+
+enum kmslife_engine {
+	KMSLIFE_ENGINE_RULE,
+	KMSLIFE_ENGINE_MULTISTATE,
+	KMSLIFE_ENGINE_MARGOLUS,
+	KMSLIFE_ENGINE_LTL,
+};
+
+/*
+ * The bit planes of the grid always hold the current generation between
+ * calls. Engines with a storage of their own, tiles and Larger than Life,
+ * load the planes before and store them after each run of steps.
+ */
+struct kmslife {
+	enum kmslife_engine engine;
+	struct grid *grid;
+	struct pool *pool;
+	unsigned int states;
+	unsigned long generation;
+
+	struct rule rule;
+	struct multistate_rule multistate_rule;
+	struct margolus_rule margolus_rule;
+	struct ltl_rule ltl_rule;
+
+	struct tiles *tiles;
+	struct ltl *ltl;
+};
+
+/* tries the notations in the same order as the kmslife program */
+static int kmslife_parse_rule(struct kmslife *life, const char *rule)
+{
+	if (multistate_parse_rule(&life->multistate_rule, rule) == 0) {
+		life->engine = KMSLIFE_ENGINE_MULTISTATE;
+		life->states = life->multistate_rule.states;
+	} else if (margolus_parse_rule(&life->margolus_rule, rule) == 0) {
+		life->engine = KMSLIFE_ENGINE_MARGOLUS;
+		life->states = 2;
+	} else if (rule_parse(&life->rule, rule) == 0) {
+		life->engine = KMSLIFE_ENGINE_RULE;
+		life->states = 2;
+	} else if (ltl_parse_rule(&life->ltl_rule, rule) == 0) {
+		life->engine = KMSLIFE_ENGINE_LTL;
+		life->states = life->ltl_rule.states;
+	} else {
+		return -ENOTSUP;
+	}
+
+	return 0;
+}
+
+static int kmslife_setup(struct kmslife *life, const char *rule,
+			 unsigned int width, unsigned int height,
+			 unsigned int flags)
+{
+	enum tile_order order = TILE_ORDER_ROWS;
+	bool in_place = flags & KMSLIFE_IN_PLACE;
+	bool tiled = flags & (KMSLIFE_TILES | KMSLIFE_MORTON);
+	struct grid *grid;
+	int err;
+
+	err = kmslife_parse_rule(life, rule ? rule : "B3/S23");
+	if (err < 0)
+		return err;
+
+	/* only Conway's Life has in-place and tiled variants */
+	if (life->engine != KMSLIFE_ENGINE_RULE && (in_place || tiled))
+		return -EINVAL;
+
+	if (tiled && !rule_is_life(&life->rule))
+		return -EINVAL;
+
+	grid = grid_new(width, height, multistate_planes(life->states),
+			life->pool, NUMA_DEFAULT, in_place);
+	if (!grid)
+		return -ENOMEM;
+
+	life->grid = grid;
+
+	switch (life->engine) {
+	case KMSLIFE_ENGINE_RULE:
+		if (!rule_is_life(&life->rule))
+			grid->rule = &life->rule;
+
+		if (!tiled)
+			return 0;
+
+		if (flags & KMSLIFE_MORTON)
+			order = TILE_ORDER_MORTON;
+
+		return tiles_create(&life->tiles, width, height, order);
+
+	case KMSLIFE_ENGINE_MULTISTATE:
+		return multistate_create(&grid->multistate,
+					 &life->multistate_rule, width, height,
+					 grid->pitch, grid->plane_size);
+
+	case KMSLIFE_ENGINE_MARGOLUS:
+		return margolus_create(&grid->margolus, &life->margolus_rule,
+				       width, height, grid->pitch);
+
+	case KMSLIFE_ENGINE_LTL:
+		return ltl_create(&life->ltl, &life->ltl_rule, width, height);
+	}
+
+	return -EINVAL;
+}
+
+int kmslife_create(struct kmslife **lifep, unsigned int width,
+		   unsigned int height, const char *rule, unsigned int threads,
+		   unsigned int flags)
+{
+	struct kmslife *life;
+	int err;
+
+	if (!lifep || !width || !height)
+		return -EINVAL;
+
+	life = calloc(1, sizeof(*life));
+	if (!life)
+		return -ENOMEM;
+
+	err = pool_create(&life->pool, threads ? threads : 1);
+	if (err < 0) {
+		free(life);
+		return err;
+	}
+
+	err = kmslife_setup(life, rule, width, height, flags);
+	if (err < 0) {
+		kmslife_free(life);
+		return err;
+	}
+
+	*lifep = life;
+
+	return 0;
+}
+
+int kmslife_free(struct kmslife *life)
+{
+	if (!life)
+		return -EINVAL;
+
+	if (life->ltl)
+		ltl_free(life->ltl);
+
+	if (life->tiles)
+		tiles_free(life->tiles);
+
+	grid_free(life->grid);
+	pool_free(life->pool);
+	free(life);
+
+	return 0;
+}
+
+unsigned int kmslife_width(struct kmslife *life)
+{
+	return life->grid->width;
+}
+
+unsigned int kmslife_height(struct kmslife *life)
+{
+	return life->grid->height;
+}
+
+unsigned int kmslife_states(struct kmslife *life)
+{
+	return life->states;
+}
+
+unsigned int kmslife_planes(struct kmslife *life)
+{
+	return life->grid->planes;
+}
+
+size_t kmslife_pitch(struct kmslife *life)
+{
+	return life->grid->pitch;
+}
+
+unsigned long kmslife_generation(struct kmslife *life)
+{
+	return life->generation;
+}
+
+/* Larger than Life keeps one byte per cell, decaying states included */
+static void kmslife_load_ltl(struct kmslife *life)
+{
+	struct grid *grid = life->grid;
+	unsigned int x, y;
+
+	if (grid->planes == 1) {
+		ltl_from_linear(life->ltl, grid->parents, grid->pitch);
+		return;
+	}
+
+	for (y = 0; y < grid->height; y++)
+		for (x = 0; x < grid->width; x++)
+			life->ltl->cells[y * grid->width + x] =
+				grid_get_state(grid, x, y);
+}
+
+static void kmslife_store_ltl(struct kmslife *life)
+{
+	struct grid *grid = life->grid;
+	unsigned int x, y;
+
+	if (grid->planes == 1) {
+		ltl_to_linear(life->ltl, grid->parents, grid->pitch);
+		return;
+	}
+
+	for (y = 0; y < grid->height; y++)
+		for (x = 0; x < grid->width; x++)
+			grid_set_state(grid, x, y,
+				       life->ltl->cells[y * grid->width + x]);
+}
+
+/*
+ * Runs the given number of generations with the same code paths as the
+ * kmslife program, so that the throughput is the same.
+ */
+int kmslife_step(struct kmslife *life, unsigned long generations)
+{
+	struct grid *grid;
+	unsigned long i;
+
+	if (!life)
+		return -EINVAL;
+
+	grid = life->grid;
+
+	if (life->ltl) {
+		kmslife_load_ltl(life);
+
+		for (i = 0; i < generations; i++)
+			ltl_tick(life->ltl, life->pool);
+
+		kmslife_store_ltl(life);
+	} else if (life->tiles) {
+		tiles_from_linear(life->tiles, grid->parents, grid->pitch);
+
+		for (i = 0; i < generations; i++) {
+			tiles_tick(life->tiles, life->pool);
+			tiles_swap(life->tiles);
+		}
+
+		tiles_to_linear(life->tiles, grid->parents, grid->pitch);
+	} else {
+		for (i = 0; i < generations; i++) {
+			grid_tick(grid);
+			grid_swap(grid);
+		}
+	}
+
+	life->generation += generations;
+
+	return 0;
+}
+
+/* number of cells that are not dead */
+unsigned long kmslife_population(struct kmslife *life)
+{
+	return grid_population(life->grid);
+}
+
+int kmslife_randomize(struct kmslife *life, unsigned int seed)
+{
+	struct grid *grid;
+
+	if (!life)
+		return -EINVAL;
+
+	grid = life->grid;
+
+	memset(grid->parents, 0, grid->plane_size * grid->planes);
+	grid_randomize(grid, seed);
+
+	return 0;
+}
+
+static bool kmslife_rect_valid(struct kmslife *life, unsigned int x,
+			       unsigned int y, unsigned int width,
+			       unsigned int height)
+{
+	struct grid *grid = life->grid;
+
+	return x <= grid->width && width <= grid->width - x &&
+	       y <= grid->height && height <= grid->height - y;
+}
+
+/* states holds one byte per cell, rows of the rectangle stride bytes apart */
+int kmslife_set_rect(struct kmslife *life, unsigned int x, unsigned int y,
+		     unsigned int width, unsigned int height,
+		     const uint8_t *states, size_t stride)
+{
+	unsigned int i, j;
+
+	if (!life || !states || !kmslife_rect_valid(life, x, y, width, height))
+		return -EINVAL;
+
+	for (j = 0; j < height; j++)
+		for (i = 0; i < width; i++)
+			if (states[j * stride + i] >= life->states)
+				return -EINVAL;
+
+	for (j = 0; j < height; j++)
+		for (i = 0; i < width; i++)
+			grid_set_state(life->grid, x + i, y + j,
+				       states[j * stride + i]);
+
+	return 0;
+}
+
+int kmslife_get_rect(struct kmslife *life, unsigned int x, unsigned int y,
+		     unsigned int width, unsigned int height, uint8_t *states,
+		     size_t stride)
+{
+	unsigned int i, j;
+
+	if (!life || !states || !kmslife_rect_valid(life, x, y, width, height))
+		return -EINVAL;
+
+	for (j = 0; j < height; j++)
+		for (i = 0; i < width; i++)
+			states[j * stride + i] =
+				grid_get_state(life->grid, x + i, y + j);
+
+	return 0;
+}
+
+/* row y of plane p of the current generation, or NULL if out of range */
+void *kmslife_row(struct kmslife *life, unsigned int plane, unsigned int y)
+{
+	struct grid *grid;
+
+	if (!life || plane >= life->grid->planes || y >= life->grid->height)
+		return NULL;
+
+	grid = life->grid;
+
+	return grid->parents + plane * grid->plane_size +
+	       grid_row_offset(grid, y);
+}
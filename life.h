@@ -0,0 +1,51 @@
+#ifndef LIFE_H
+#define LIFE_H 1
+
+#include <stdint.h>
+
+static inline void add3(uint64_t a, uint64_t b, uint64_t c, uint64_t *sum,
+			uint64_t *carry)
+{
+	uint64_t t = a ^ b;
+
+	*sum = t ^ c;
+	*carry = (a & b) | (t & c);
+}
+
+/*
+ * Count the eight neighbours of 64 cells at a time. The count is returned
+ * in bit-sliced form, with one bit plane per binary digit.
+ */
+static inline void life_count(uint64_t nw, uint64_t n, uint64_t ne,
+			      uint64_t w, uint64_t e, uint64_t sw,
+			      uint64_t s, uint64_t se, uint64_t count[4])
+{
+	uint64_t top, top2, bot, bot2, mid, mid2;
+	uint64_t c0, c1, c2, c3;
+
+	add3(nw, n, ne, &top, &top2);
+	add3(sw, s, se, &bot, &bot2);
+	mid = w ^ e;
+	mid2 = w & e;
+
+	add3(top, bot, mid, &count[0], &c0);
+	add3(top2, bot2, mid2, &c1, &c2);
+	count[1] = c1 ^ c0;
+	c3 = c1 & c0;
+	count[2] = c2 ^ c3;
+	count[3] = c2 & c3;
+}
+
+/* born with three neighbours, survives with two or three */
+static inline uint64_t life_next(uint64_t nw, uint64_t n, uint64_t ne,
+				 uint64_t w, uint64_t c, uint64_t e,
+				 uint64_t sw, uint64_t s, uint64_t se)
+{
+	uint64_t count[4];
+
+	life_count(nw, n, ne, w, e, sw, s, se, count);
+
+	return count[1] & ~count[2] & ~count[3] & (count[0] | c);
+}
+
+#endif /* LIFE_H */
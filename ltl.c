@@ -0,0 +1,417 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ltl.h"
+
+#define LTL_MAX_RANGE 500
+
+static int ltl_parse_range(const char *ptr, unsigned int *min,
+			   unsigned int *max)
+{
+	char *end;
+
+	/* an empty range never matches */
+	if (*ptr == '\0') {
+		*min = 1;
+		*max = 0;
+		return 0;
+	}
+
+	*min = strtoul(ptr, &end, 10);
+	if (end == ptr || strncmp(end, "..", 2) != 0)
+		return -EINVAL;
+
+	ptr = end + 2;
+
+	*max = strtoul(ptr, &end, 10);
+	if (end == ptr || *end != '\0')
+		return -EINVAL;
+
+	return 0;
+}
+
+/*
+ * Parses rules of the form "R5,C0,M1,S34..58,B34..45,NM" as used in the
+ * rule field of RLE files: range, number of states (0 and 2 both meaning
+ * two), whether the middle cell is counted, survival and birth ranges and
+ * the neighbourhood, Moore (box) or von Neumann (diamond).
+ */
+int ltl_parse_rule(struct ltl_rule *rule, const char *string)
+{
+	char *copy, *token, *save, *end;
+	bool range = false;
+	unsigned long value;
+	int err = 0;
+
+	memset(rule, 0, sizeof(*rule));
+	rule->states = 2;
+	rule->neighbourhood = LTL_MOORE;
+	rule->survive_min = rule->birth_min = 1;
+
+	copy = strdup(string);
+	if (!copy)
+		return -ENOMEM;
+
+	for (token = strtok_r(copy, ",", &save); token && !err;
+	     token = strtok_r(NULL, ",", &save)) {
+		switch (toupper(token[0])) {
+		case 'R':
+			value = strtoul(token + 1, &end, 10);
+			if (end == token + 1 || *end || !value ||
+			    value > LTL_MAX_RANGE)
+				err = -EINVAL;
+
+			rule->range = value;
+			range = true;
+			break;
+
+		case 'C':
+			value = strtoul(token + 1, &end, 10);
+			if (end == token + 1 || *end || value == 1 ||
+			    value > 256)
+				err = -EINVAL;
+
+			rule->states = value < 2 ? 2 : value;
+			break;
+
+		case 'M':
+			if (strcmp(token + 1, "0") && strcmp(token + 1, "1"))
+				err = -EINVAL;
+
+			rule->middle = token[1] == '1';
+			break;
+
+		case 'S':
+			err = ltl_parse_range(token + 1, &rule->survive_min,
+					      &rule->survive_max);
+			break;
+
+		case 'B':
+			err = ltl_parse_range(token + 1, &rule->birth_min,
+					      &rule->birth_max);
+			break;
+
+		case 'N':
+			if (toupper(token[1]) == 'M' && !token[2])
+				rule->neighbourhood = LTL_MOORE;
+			else if (toupper(token[1]) == 'N' && !token[2])
+				rule->neighbourhood = LTL_VON_NEUMANN;
+			else
+				err = -EINVAL;
+			break;
+
+		default:
+			err = -EINVAL;
+			break;
+		}
+	}
+
+	free(copy);
+
+	if (!err && !range)
+		err = -EINVAL;
+
+	return err;
+}
+
+int ltl_create(struct ltl **ltlp, const struct ltl_rule *rule,
+	       unsigned int width, unsigned int height)
+{
+	unsigned int range = rule->range, i;
+	size_t size = (size_t)width * height;
+	struct ltl *ltl;
+
+	/* the neighbourhood must not wrap around onto itself */
+	if (width <= 2 * range || height <= 2 * range)
+		return -EINVAL;
+
+	ltl = calloc(1, sizeof(*ltl));
+	if (!ltl)
+		return -ENOMEM;
+
+	ltl->rule = *rule;
+	ltl->width = width;
+	ltl->height = height;
+	ltl->columns = width + 2 * range;
+	ltl->rows = height + 2 * range;
+
+	ltl->cells = calloc(size, 1);
+	ltl->next = calloc(size, 1);
+	ltl->wrap_x = calloc(ltl->columns, sizeof(*ltl->wrap_x));
+	ltl->wrap_y = calloc(ltl->rows, sizeof(*ltl->wrap_y));
+	ltl->sums = calloc((size_t)(ltl->columns + 1) * (ltl->rows + 1),
+			   sizeof(*ltl->sums));
+
+	if (rule->neighbourhood == LTL_VON_NEUMANN) {
+		size = (size_t)(ltl->columns + 2) * (ltl->rows + 1);
+		ltl->diagonal = calloc(size, sizeof(*ltl->diagonal));
+		ltl->antidiagonal = calloc(size, sizeof(*ltl->antidiagonal));
+
+		if (!ltl->diagonal || !ltl->antidiagonal) {
+			ltl_free(ltl);
+			return -ENOMEM;
+		}
+	}
+
+	if (!ltl->cells || !ltl->next || !ltl->wrap_x || !ltl->wrap_y ||
+	    !ltl->sums) {
+		ltl_free(ltl);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < ltl->columns; i++)
+		ltl->wrap_x[i] = (i + width - range) % width;
+
+	for (i = 0; i < ltl->rows; i++)
+		ltl->wrap_y[i] = (i + height - range) % height;
+
+	*ltlp = ltl;
+
+	return 0;
+}
+
+int ltl_free(struct ltl *ltl)
+{
+	if (!ltl)
+		return -EINVAL;
+
+	free(ltl->antidiagonal);
+	free(ltl->diagonal);
+	free(ltl->sums);
+	free(ltl->wrap_y);
+	free(ltl->wrap_x);
+	free(ltl->next);
+	free(ltl->cells);
+	free(ltl);
+
+	return 0;
+}
+
+void ltl_from_linear(struct ltl *ltl, const void *src, unsigned int pitch)
+{
+	const uint8_t *row;
+	unsigned int x, y;
+
+	for (y = 0; y < ltl->height; y++) {
+		row = (const uint8_t *)src + (size_t)y * pitch;
+
+		for (x = 0; x < ltl->width; x++)
+			ltl->cells[y * ltl->width + x] =
+				(row[x / 8] >> (x % 8)) & 1;
+	}
+}
+
+/* only live cells are set, decaying cells are shown as dead */
+void ltl_to_linear(struct ltl *ltl, void *dst, unsigned int pitch)
+{
+	uint8_t *row;
+	unsigned int x, y;
+
+	for (y = 0; y < ltl->height; y++) {
+		row = (uint8_t *)dst + (size_t)y * pitch;
+		memset(row, 0, pitch);
+
+		for (x = 0; x < ltl->width; x++)
+			if (ltl->cells[y * ltl->width + x] == 1)
+				row[x / 8] |= 1 << (x % 8);
+	}
+}
+
+static inline unsigned int ltl_alive(struct ltl *ltl, unsigned int x,
+				     unsigned int y)
+{
+	return ltl->cells[ltl->wrap_y[y] * ltl->width + ltl->wrap_x[x]] == 1;
+}
+
+static void ltl_band(unsigned int size, unsigned int index,
+		     unsigned int count, unsigned int *start,
+		     unsigned int *end)
+{
+	*start = (unsigned long)size * index / count;
+	*end = (unsigned long)size * (index + 1) / count;
+}
+
+/* prefix sums along each row of the padded universe */
+static void ltl_sum_rows(void *data, unsigned int index, unsigned int count)
+{
+	struct ltl *ltl = data;
+	unsigned int stride = ltl->columns + 1, start, end, x, y;
+	uint32_t *row, sum;
+
+	ltl_band(ltl->rows, index, count, &start, &end);
+
+	for (y = start; y < end; y++) {
+		row = ltl->sums + (size_t)(y + 1) * stride;
+
+		for (x = 0, sum = 0; x < ltl->columns; x++) {
+			sum += ltl_alive(ltl, x, y);
+			row[x + 1] = sum;
+		}
+	}
+}
+
+/* accumulates the row sums down each column */
+static void ltl_sum_columns(void *data, unsigned int index,
+			    unsigned int count)
+{
+	struct ltl *ltl = data;
+	unsigned int stride = ltl->columns + 1, start, end, x, y;
+	const uint32_t *above;
+	uint32_t *row;
+
+	ltl_band(ltl->columns, index, count, &start, &end);
+
+	for (y = 1; y < ltl->rows; y++) {
+		above = ltl->sums + (size_t)y * stride;
+		row = ltl->sums + (size_t)(y + 1) * stride;
+
+		for (x = start; x < end; x++)
+			row[x + 1] += above[x + 1];
+	}
+}
+
+/* number of live cells in a rectangle of the padded universe */
+static inline uint32_t ltl_box(struct ltl *ltl, unsigned int x0,
+			       unsigned int y0, unsigned int x1,
+			       unsigned int y1)
+{
+	unsigned int stride = ltl->columns + 1;
+	const uint32_t *top = ltl->sums + (size_t)y0 * stride;
+	const uint32_t *bottom = ltl->sums + (size_t)(y1 + 1) * stride;
+
+	return bottom[x1 + 1] - top[x1 + 1] - bottom[x0] + top[x0];
+}
+
+/*
+ * Prefix sums along both diagonals. The tables have an extra row at the
+ * top and an extra column on either side that stay zero.
+ */
+static void ltl_sum_diagonals(struct ltl *ltl)
+{
+	int stride = ltl->columns + 2, x, y;
+	uint32_t *diagonal, *antidiagonal, alive;
+
+	for (y = 0; y < (int)ltl->rows; y++) {
+		diagonal = ltl->diagonal + (size_t)(y + 1) * stride + 1;
+		antidiagonal = ltl->antidiagonal + (size_t)(y + 1) * stride + 1;
+
+		for (x = 0; x < (int)ltl->columns; x++) {
+			alive = ltl_alive(ltl, x, y);
+			diagonal[x] = alive + diagonal[x - 1 - stride];
+			antidiagonal[x] = alive + antidiagonal[x + 1 - stride];
+		}
+	}
+}
+
+static inline uint32_t ltl_diagonal(struct ltl *ltl, const uint32_t *table,
+				    int x, int y)
+{
+	return table[(size_t)(y + 1) * (ltl->columns + 2) + x + 1];
+}
+
+/*
+ * Live cells on the left (dx <= 0) or right (dx >= 0) edge of the diamond
+ * of the given range around a cell of the padded universe. Each edge
+ * consists of two diagonal segments that share the tip.
+ */
+static uint32_t ltl_diamond_edge(struct ltl *ltl, int x, int y, int r,
+				 bool right)
+{
+	const uint32_t *d = ltl->diagonal, *a = ltl->antidiagonal;
+
+	if (right)
+		return ltl_diagonal(ltl, d, x + r, y) -
+		       ltl_diagonal(ltl, d, x - 1, y - r - 1) +
+		       ltl_diagonal(ltl, a, x, y + r) -
+		       ltl_diagonal(ltl, a, x + r + 1, y - 1) -
+		       ltl_alive(ltl, x + r, y);
+
+	return ltl_diagonal(ltl, a, x - r, y) -
+	       ltl_diagonal(ltl, a, x + 1, y - r - 1) +
+	       ltl_diagonal(ltl, d, x, y + r) -
+	       ltl_diagonal(ltl, d, x - r - 1, y - 1) -
+	       ltl_alive(ltl, x - r, y);
+}
+
+static inline uint8_t ltl_next(const struct ltl_rule *rule, uint8_t state,
+			       unsigned int count)
+{
+	if (state == 0)
+		return count >= rule->birth_min && count <= rule->birth_max;
+
+	if (state == 1) {
+		if (count >= rule->survive_min && count <= rule->survive_max)
+			return 1;
+
+		return rule->states > 2 ? 2 : 0;
+	}
+
+	return state + 1 < rule->states ? state + 1 : 0;
+}
+
+static void ltl_tick_band(void *data, unsigned int index, unsigned int count)
+{
+	struct ltl *ltl = data;
+	const struct ltl_rule *rule = &ltl->rule;
+	unsigned int r = rule->range, start, end, x, y;
+	uint32_t sum = 0;
+	int dy, w;
+
+	ltl_band(ltl->height, index, count, &start, &end);
+
+	for (y = start; y < end; y++) {
+		const uint8_t *row = ltl->cells + (size_t)y * ltl->width;
+		uint8_t *out = ltl->next + (size_t)y * ltl->width;
+
+		/* the first diamond of each row is summed row by row */
+		if (rule->neighbourhood == LTL_VON_NEUMANN) {
+			for (dy = -(int)r, sum = 0; dy <= (int)r; dy++) {
+				w = r - abs(dy);
+				sum += ltl_box(ltl, r - w, y + r + dy, r + w,
+					       y + r + dy);
+			}
+		}
+
+		for (x = 0; x < ltl->width; x++) {
+			uint32_t neighbours;
+
+			if (rule->neighbourhood == LTL_MOORE) {
+				neighbours = ltl_box(ltl, x, y, x + 2 * r,
+						     y + 2 * r);
+			} else {
+				neighbours = sum;
+
+				/* slide the diamond one cell to the right */
+				if (x + 1 < ltl->width)
+					sum += ltl_diamond_edge(ltl, x + r + 1,
+								y + r, r, true) -
+					       ltl_diamond_edge(ltl, x + r,
+								y + r, r, false);
+			}
+
+			if (!rule->middle)
+				neighbours -= row[x] == 1;
+
+			out[x] = ltl_next(rule, row[x], neighbours);
+		}
+	}
+}
+
+void ltl_tick(struct ltl *ltl, struct pool *pool)
+{
+	uint8_t *tmp;
+
+	pool_run(pool, ltl_sum_rows, ltl);
+	pool_run(pool, ltl_sum_columns, ltl);
+
+	if (ltl->rule.neighbourhood == LTL_VON_NEUMANN)
+		ltl_sum_diagonals(ltl);
+
+	pool_run(pool, ltl_tick_band, ltl);
+
+	tmp = ltl->cells;
+	ltl->cells = ltl->next;
+	ltl->next = tmp;
+}
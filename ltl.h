@@ -0,0 +1,61 @@
+#ifndef LTL_H
+#define LTL_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pool.h"
+
+enum ltl_neighbourhood {
+	LTL_MOORE,
+	LTL_VON_NEUMANN,
+};
+
+/* a rule such as "R5,C0,M1,S34..58,B34..45,NM" (Bosco's rule) */
+struct ltl_rule {
+	unsigned int range;
+	unsigned int states;
+	bool middle;
+	unsigned int survive_min;
+	unsigned int survive_max;
+	unsigned int birth_min;
+	unsigned int birth_max;
+	enum ltl_neighbourhood neighbourhood;
+};
+
+/*
+ * Larger-than-Life universe with one byte per cell holding its state:
+ * 0 is dead, 1 is alive and higher states are decaying. Neighbour counts
+ * are taken from prefix sums over a copy of the universe that is padded
+ * by the range on each side, so the cost per cell does not depend on the
+ * range.
+ */
+struct ltl {
+	struct ltl_rule rule;
+	unsigned int width;
+	unsigned int height;
+
+	uint8_t *cells;
+	uint8_t *next;
+
+	/* dimensions of the padded universe */
+	unsigned int columns;
+	unsigned int rows;
+	unsigned int *wrap_x;
+	unsigned int *wrap_y;
+
+	/* summed-area table for boxes, diagonal prefix sums for diamonds */
+	uint32_t *sums;
+	uint32_t *diagonal;
+	uint32_t *antidiagonal;
+};
+
+int ltl_parse_rule(struct ltl_rule *rule, const char *string);
+int ltl_create(struct ltl **ltlp, const struct ltl_rule *rule,
+	       unsigned int width, unsigned int height);
+int ltl_free(struct ltl *ltl);
+void ltl_from_linear(struct ltl *ltl, const void *src, unsigned int pitch);
+void ltl_to_linear(struct ltl *ltl, void *dst, unsigned int pitch);
+void ltl_tick(struct ltl *ltl, struct pool *pool);
+
+#endif /* LTL_H */
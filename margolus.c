@@ -0,0 +1,321 @@
+#include <endian.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "margolus.h"
+
+#define MARGOLUS_EVEN 0x5555555555555555ull
+
+static const struct {
+	const char *name;
+	const char *rule;
+} margolus_rules[] = {
+	{ "BBM", "M0,8,4,3,2,5,9,7,1,6,10,11,12,13,14,15" },
+	{ "Critters", "M15,14,13,3,11,5,6,1,7,9,10,2,12,4,8,0" },
+	{ "Tron", "M15,1,2,3,4,5,6,7,8,9,10,11,12,13,14,0" },
+};
+
+static void margolus_outputs(uint16_t *outputs, const uint8_t *table)
+{
+	unsigned int o, v;
+
+	for (o = 0; o < 4; o++) {
+		outputs[o] = 0;
+
+		for (v = 0; v < 16; v++)
+			if (table[v] & (1 << o))
+				outputs[o] |= 1 << v;
+	}
+}
+
+/*
+ * Parses rules given as the 16 entries of the block table, e.g. "M0,8,4,3,
+ * 2,5,9,7,1,6,10,11,12,13,14,15" for the billiard ball machine, or one of
+ * the names BBM, Critters and Tron.
+ */
+int margolus_parse_rule(struct margolus_rule *rule, const char *string)
+{
+	uint8_t table[16];
+	unsigned long value;
+	unsigned int i, p;
+	uint16_t seen = 0;
+	char *end;
+
+	for (i = 0; i < sizeof(margolus_rules) / sizeof(margolus_rules[0]); i++)
+		if (strcasecmp(string, margolus_rules[i].name) == 0)
+			string = margolus_rules[i].rule;
+
+	if (*string != 'M' && *string != 'm')
+		return -EINVAL;
+
+	string++;
+
+	for (i = 0; i < 16; i++) {
+		value = strtoul(string, &end, 10);
+		if (end == string || value > 15)
+			return -EINVAL;
+
+		if (i < 15 && *end != ',' && *end != ';')
+			return -EINVAL;
+
+		table[i] = value;
+		string = end + (i < 15);
+	}
+
+	if (*string)
+		return -EINVAL;
+
+	memset(rule, 0, sizeof(*rule));
+
+	for (i = 0; i < 16; i++) {
+		if (table[0] == 15 && table[15] == 0) {
+			rule->table[0][i] = 15 - table[i];
+			rule->table[1][i] = table[15 - i];
+		} else {
+			rule->table[0][i] = table[i];
+			rule->table[1][i] = table[i];
+		}
+
+		seen |= 1 << table[i];
+	}
+
+	/* only permutations of the block contents can be undone */
+	rule->reversible = seen == 0xffff;
+
+	for (p = 0; p < 2; p++) {
+		for (i = 0; i < 16; i++)
+			rule->inverse[p][rule->table[p][i]] = i;
+
+		margolus_outputs(rule->outputs[p][0], rule->table[p]);
+
+		if (rule->reversible)
+			margolus_outputs(rule->outputs[p][1],
+					 rule->inverse[p]);
+	}
+
+	return 0;
+}
+
+int margolus_create(struct margolus **margolusp,
+		    const struct margolus_rule *rule, unsigned int width,
+		    unsigned int height, unsigned int pitch)
+{
+	struct margolus *margolus;
+
+	/* blocks must tile the torus in both phases */
+	if (!width || !height || width % 2 || height % 2 ||
+	    pitch < (width + 63) / 64 * 8)
+		return -EINVAL;
+
+	margolus = calloc(1, sizeof(*margolus));
+	if (!margolus)
+		return -ENOMEM;
+
+	margolus->rule = *rule;
+	margolus->width = width;
+	margolus->height = height;
+	margolus->pitch = pitch;
+	margolus->words = (width + 63) / 64;
+	margolus->mask = ~0ull >> (margolus->words * 64 - width);
+
+	*margolusp = margolus;
+
+	return 0;
+}
+
+int margolus_free(struct margolus *margolus)
+{
+	if (!margolus)
+		return -EINVAL;
+
+	free(margolus);
+
+	return 0;
+}
+
+/*
+ * Applies a table to the 32 blocks held in bit pairs 2k and 2k + 1 of two
+ * rows. The four cells of all blocks are split into separate words, from
+ * which each of the 16 possible block contents is selected with two ANDs
+ * and added to the cells of the result that the table sets for it.
+ */
+static inline void margolus_block(const uint16_t *outputs, uint64_t *top,
+				  uint64_t *bottom)
+{
+	uint64_t ul = *top, ur = *top >> 1, ll = *bottom, lr = *bottom >> 1;
+	uint64_t upper[4], lower[4], block, out[4] = { 0 };
+	unsigned int o, v;
+
+	upper[0] = ~ul & ~ur & MARGOLUS_EVEN;
+	upper[1] = ul & ~ur & MARGOLUS_EVEN;
+	upper[2] = ~ul & ur & MARGOLUS_EVEN;
+	upper[3] = ul & ur & MARGOLUS_EVEN;
+
+	lower[0] = ~ll & ~lr;
+	lower[1] = ll & ~lr;
+	lower[2] = ~ll & lr;
+	lower[3] = ll & lr;
+
+	for (v = 0; v < 16; v++) {
+		block = upper[v & 3] & lower[v >> 2];
+
+		for (o = 0; o < 4; o++)
+			out[o] |= block & -(uint64_t)((outputs[o] >> v) & 1);
+	}
+
+	*top = out[0] | out[1] << 1;
+	*bottom = out[2] | out[3] << 1;
+}
+
+/* word i of a row with each bit holding its east neighbour */
+static inline uint64_t margolus_east(struct margolus *margolus,
+				     const uint64_t *row, unsigned int i)
+{
+	unsigned int last = margolus->words - 1;
+	uint64_t word = le64toh(row[i]) >> 1;
+
+	if (i < last)
+		return word | le64toh(row[i + 1]) << 63;
+
+	return word | (le64toh(row[0]) & 1) << ((margolus->width - 1) % 64);
+}
+
+/* blocks start at even columns */
+static void margolus_pair_even(struct margolus *margolus,
+			       const uint16_t *outputs, const uint64_t *above,
+			       const uint64_t *below, uint64_t *top,
+			       uint64_t *bottom)
+{
+	unsigned int last = margolus->words - 1, i;
+	uint64_t t, b;
+
+	for (i = 0; i <= last; i++) {
+		t = le64toh(above[i]);
+		b = le64toh(below[i]);
+
+		margolus_block(outputs, &t, &b);
+
+		if (i == last) {
+			t &= margolus->mask;
+			b &= margolus->mask;
+		}
+
+		top[i] = htole64(t);
+		bottom[i] = htole64(b);
+	}
+}
+
+/*
+ * Blocks start at odd columns, so the rows are shifted by one cell to put
+ * them on bit pairs 2k and 2k + 1, and the results are shifted back. The
+ * last word is done first since its first cell wraps around into word 0.
+ */
+static void margolus_pair_odd(struct margolus *margolus,
+			      const uint16_t *outputs, const uint64_t *above,
+			      const uint64_t *below, uint64_t *top,
+			      uint64_t *bottom)
+{
+	unsigned int last = margolus->words - 1, msb = (margolus->width - 1) % 64;
+	uint64_t t, b, prev_t, prev_b, wrap_t, wrap_b;
+	unsigned int i;
+
+	wrap_t = margolus_east(margolus, above, last);
+	wrap_b = margolus_east(margolus, below, last);
+	margolus_block(outputs, &wrap_t, &wrap_b);
+
+	prev_t = (wrap_t >> msb) & 1;
+	prev_b = (wrap_b >> msb) & 1;
+
+	for (i = 0; i <= last; i++) {
+		if (i < last) {
+			t = margolus_east(margolus, above, i);
+			b = margolus_east(margolus, below, i);
+			margolus_block(outputs, &t, &b);
+		} else {
+			t = wrap_t;
+			b = wrap_b;
+		}
+
+		top[i] = t << 1 | prev_t;
+		bottom[i] = b << 1 | prev_b;
+
+		prev_t = t >> 63;
+		prev_b = b >> 63;
+
+		if (i == last) {
+			top[i] &= margolus->mask;
+			bottom[i] &= margolus->mask;
+		}
+
+		top[i] = htole64(top[i]);
+		bottom[i] = htole64(bottom[i]);
+	}
+}
+
+static void margolus_tick_band(void *data, unsigned int index,
+			       unsigned int count)
+{
+	struct margolus *margolus = data;
+	unsigned int pairs = margolus->height / 2, rows, start, end, k;
+	unsigned long generation = margolus->generation;
+	unsigned int phase, top, bottom;
+	const uint16_t *outputs;
+
+	if (margolus->backwards)
+		generation--;
+
+	phase = generation & 1;
+	outputs = margolus->rule.outputs[phase][margolus->backwards];
+
+	rows = (pairs + count - 1) / count;
+	start = index * rows;
+	end = start + rows;
+
+	if (end > pairs)
+		end = pairs;
+
+	for (k = start; k < end; k++) {
+		top = 2 * k + phase;
+		bottom = (top + 1) % margolus->height;
+
+		if (phase)
+			margolus_pair_odd(margolus, outputs,
+					  margolus->src + top * margolus->pitch,
+					  margolus->src + bottom * margolus->pitch,
+					  margolus->dst + top * margolus->pitch,
+					  margolus->dst + bottom * margolus->pitch);
+		else
+			margolus_pair_even(margolus, outputs,
+					   margolus->src + top * margolus->pitch,
+					   margolus->src + bottom * margolus->pitch,
+					   margolus->dst + top * margolus->pitch,
+					   margolus->dst + bottom * margolus->pitch);
+	}
+}
+
+/*
+ * Computes the next generation, or the previous one if backwards is set
+ * and the rule is reversible, in which case the inverse table is applied
+ * with the block offset of the previous generation.
+ */
+int margolus_tick(struct margolus *margolus, struct pool *pool,
+		  const void *src, void *dst, bool backwards)
+{
+	if (backwards && !margolus->rule.reversible)
+		return -ENOTSUP;
+
+	margolus->src = src;
+	margolus->dst = dst;
+	margolus->backwards = backwards;
+
+	pool_run(pool, margolus_tick_band, margolus);
+
+	if (backwards)
+		margolus->generation--;
+	else
+		margolus->generation++;
+
+	return 0;
+}
@@ -0,0 +1,55 @@
+#ifndef MARGOLUS_H
+#define MARGOLUS_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pool.h"
+
+/*
+ * Block rule on the Margolus neighbourhood: the universe is split into 2x2
+ * blocks, offset by one cell in both directions on every other generation,
+ * and each block is replaced according to a table indexed by its cells,
+ * with the upper left cell in bit 0, upper right in bit 1, lower left in
+ * bit 2 and lower right in bit 3.
+ *
+ * Rules that turn empty blocks into full ones and back, such as Critters,
+ * would make the whole universe flash. Their odd generations are stored
+ * complemented instead, by running the rule followed by a complement on
+ * even generations and a complement followed by the rule on odd ones.
+ */
+struct margolus_rule {
+	/* table for even and odd generations and their inverses */
+	uint8_t table[2][16];
+	uint8_t inverse[2][16];
+	bool reversible;
+
+	/* bit o of the result of each table as a set of block contents */
+	uint16_t outputs[2][2][4];
+};
+
+struct margolus {
+	struct margolus_rule rule;
+	unsigned int width;
+	unsigned int height;
+	unsigned int pitch;
+	unsigned int words;
+	uint64_t mask;
+
+	/* generation of the universe, which decides the block offset */
+	unsigned long generation;
+
+	const void *src;
+	void *dst;
+	bool backwards;
+};
+
+int margolus_parse_rule(struct margolus_rule *rule, const char *string);
+int margolus_create(struct margolus **margolusp,
+		    const struct margolus_rule *rule, unsigned int width,
+		    unsigned int height, unsigned int pitch);
+int margolus_free(struct margolus *margolus);
+int margolus_tick(struct margolus *margolus, struct pool *pool,
+		  const void *src, void *dst, bool backwards);
+
+#endif /* MARGOLUS_H */
@@ -0,0 +1,349 @@
+#include <endian.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "life.h"
+#include "multistate.h"
+
+/*
+ * Parses the Generations rules "S/B/C" and "B/S/C", e.g. "345/2/4" or
+ * "B2/S345/C4", optionally followed by H or V for the hexagonal or von
+ * Neumann neighbourhood, and "WireWorld".
+ */
+int multistate_parse_rule(struct multistate_rule *rule, const char *string)
+{
+	const char *states, *suffix;
+	char buffer[64];
+	unsigned long value;
+	char *end;
+	int err;
+
+	memset(rule, 0, sizeof(*rule));
+
+	if (strcasecmp(string, "WireWorld") == 0) {
+		rule->family = MULTISTATE_WIREWORLD;
+		rule->states = 4;
+		return 0;
+	}
+
+	states = strrchr(string, '/');
+	if (!states || states == strchr(string, '/'))
+		return -EINVAL;
+
+	if (states - string >= (int)sizeof(buffer) - 2)
+		return -EINVAL;
+
+	suffix = ++states;
+
+	if (*suffix == 'C' || *suffix == 'c')
+		suffix++;
+
+	value = strtoul(suffix, &end, 10);
+	if (end == suffix || value < 2 || value > MULTISTATE_MAX_STATES)
+		return -EINVAL;
+
+	/* pass the birth and survival part on with the neighbourhood */
+	snprintf(buffer, sizeof(buffer), "%.*s%s",
+		 (int)(states - string - 1), string, end);
+
+	err = rule_parse(&rule->rule, buffer);
+	if (err < 0)
+		return err;
+
+	rule->family = MULTISTATE_GENERATIONS;
+	rule->states = value;
+
+	return 0;
+}
+
+unsigned int multistate_planes(unsigned int states)
+{
+	unsigned int planes = 1;
+
+	while ((1u << planes) < states)
+		planes++;
+
+	return planes;
+}
+
+int multistate_create(struct multistate **multistatep,
+		      const struct multistate_rule *rule, unsigned int width,
+		      unsigned int height, unsigned int pitch, size_t stride)
+{
+	struct multistate *multistate;
+
+	if (!width || !height || pitch < (width + 63) / 64 * 8)
+		return -EINVAL;
+
+	multistate = calloc(1, sizeof(*multistate));
+	if (!multistate)
+		return -ENOMEM;
+
+	multistate->rule = *rule;
+	multistate->width = width;
+	multistate->height = height;
+	multistate->pitch = pitch;
+	multistate->words = (width + 63) / 64;
+	multistate->planes = multistate_planes(rule->states);
+	multistate->stride = stride;
+	multistate->mask = ~0ull >> (multistate->words * 64 - width);
+
+	multistate->alive = calloc((size_t)multistate->words * height,
+				   sizeof(uint64_t));
+	if (!multistate->alive) {
+		free(multistate);
+		return -ENOMEM;
+	}
+
+	*multistatep = multistate;
+
+	return 0;
+}
+
+int multistate_free(struct multistate *multistate)
+{
+	if (!multistate)
+		return -EINVAL;
+
+	free(multistate->alive);
+	free(multistate);
+
+	return 0;
+}
+
+static inline const uint64_t *multistate_row(struct multistate *multistate,
+					     const void *base,
+					     unsigned int plane,
+					     unsigned int y)
+{
+	return base + plane * multistate->stride + y * multistate->pitch;
+}
+
+static void multistate_band(struct multistate *multistate, unsigned int index,
+			    unsigned int count, unsigned int *start,
+			    unsigned int *end)
+{
+	unsigned int rows = (multistate->height + count - 1) / count;
+
+	*start = index * rows;
+	*end = *start + rows;
+
+	if (*start > multistate->height)
+		*start = multistate->height;
+
+	if (*end > multistate->height)
+		*end = multistate->height;
+}
+
+/* extracts the cells in state 1, the ones that count as neighbours */
+static void multistate_alive_band(void *data, unsigned int index,
+				  unsigned int count)
+{
+	struct multistate *multistate = data;
+	unsigned int start, end, p, i, y;
+	uint64_t word;
+
+	multistate_band(multistate, index, count, &start, &end);
+
+	for (y = start; y < end; y++) {
+		for (i = 0; i < multistate->words; i++) {
+			word = le64toh(multistate_row(multistate,
+					multistate->src, 0, y)[i]);
+
+			for (p = 1; p < multistate->planes; p++)
+				word &= ~le64toh(multistate_row(multistate,
+						multistate->src, p, y)[i]);
+
+			if (i == multistate->words - 1)
+				word &= multistate->mask;
+
+			multistate->alive[y * multistate->words + i] = word;
+		}
+	}
+}
+
+/*
+ * Load word i of a row of live cells along with the same word shifted such
+ * that each bit holds its west or east neighbour, wrapping around at the
+ * edges.
+ */
+static inline void multistate_load(struct multistate *multistate,
+				   unsigned int y, unsigned int i,
+				   uint64_t *west, uint64_t *center,
+				   uint64_t *east)
+{
+	const uint64_t *row = multistate->alive + y * multistate->words;
+	unsigned int last = multistate->words - 1;
+	unsigned int msb = (multistate->width - 1) % 64;
+	uint64_t word = row[i];
+
+	*center = word;
+	*west = word << 1;
+	*east = word >> 1;
+
+	if (i > 0)
+		*west |= row[i - 1] >> 63;
+	else
+		*west |= (row[last] >> msb) & 1;
+
+	if (i < last)
+		*east |= row[i + 1] << 63;
+	else
+		*east |= (row[0] & 1) << msb;
+}
+
+static inline void multistate_store(struct multistate *multistate,
+				    unsigned int y, unsigned int i,
+				    const uint64_t *out)
+{
+	unsigned int p;
+
+	for (p = 0; p < multistate->planes; p++)
+		((uint64_t *)multistate_row(multistate, multistate->dst, p,
+					    y))[i] = htole64(out[p]);
+}
+
+/*
+ * Live cells are born and survive according to the two-state rule, whose
+ * circuit runs for RULE_WORDS words at a time. All other cells that are
+ * not dead advance to the next state, with the state after the last one
+ * being dead again, which a bit-sliced increment and a comparison with the
+ * number of states handle for all planes at once.
+ */
+static void multistate_tick_generations(struct multistate *multistate,
+					unsigned int y)
+{
+	uint64_t inputs[RULE_NUM_INPUTS][RULE_WORDS] = { { 0 } };
+	unsigned int words = multistate->words;
+	unsigned int states = multistate->rule.states;
+	unsigned int above = (y + multistate->height - 1) % multistate->height;
+	unsigned int below = (y + 1) % multistate->height;
+	uint64_t next[RULE_WORDS], plane, increment[8], out[8];
+	uint64_t alive, born, carry, any, wrap;
+	unsigned int batch, i, j, p;
+
+	for (i = 0; i < words; i += RULE_WORDS) {
+		batch = words - i < RULE_WORDS ? words - i : RULE_WORDS;
+
+		for (j = 0; j < batch; j++) {
+			uint64_t nw, n, ne, w, c, e, sw, s, se;
+
+			multistate_load(multistate, above, i + j,
+					&nw, &n, &ne);
+			multistate_load(multistate, y, i + j, &w, &c, &e);
+			multistate_load(multistate, below, i + j,
+					&sw, &s, &se);
+
+			rule_load(&multistate->rule.rule, inputs, j,
+				  nw, n, ne, w, c, e, sw, s, se);
+		}
+
+		rule_eval(&multistate->rule.rule, inputs, next);
+
+		for (j = 0; j < batch; j++) {
+			alive = multistate->alive[y * words + i + j];
+			carry = ~0ull;
+			wrap = ~0ull;
+			any = 0;
+
+			for (p = 0; p < multistate->planes; p++) {
+				plane = le64toh(multistate_row(multistate,
+						multistate->src, p, y)[i + j]);
+				any |= plane;
+
+				increment[p] = plane ^ carry;
+				carry &= plane;
+
+				if (states & (1 << p))
+					wrap &= increment[p];
+				else
+					wrap &= ~increment[p];
+			}
+
+			/* only dead and live cells may be born or survive */
+			born = next[j] & (alive | ~any);
+			if (i + j == words - 1)
+				born &= multistate->mask;
+
+			for (p = 0; p < multistate->planes; p++)
+				out[p] = increment[p] & any & ~born & ~wrap;
+
+			out[0] |= born;
+
+			multistate_store(multistate, y, i + j, out);
+		}
+	}
+}
+
+/*
+ * Electron heads become tails, tails become conductors and conductors
+ * become heads if one or two of their neighbours are heads. The states
+ * are 1, 2 and 3, so heads are the cells counted as live.
+ */
+static void multistate_tick_wireworld(struct multistate *multistate,
+				      unsigned int y)
+{
+	unsigned int above = (y + multistate->height - 1) % multistate->height;
+	unsigned int below = (y + 1) % multistate->height;
+	uint64_t s0, s1, head, tail, conductor, excited, count[4], out[2];
+	unsigned int i;
+
+	for (i = 0; i < multistate->words; i++) {
+		uint64_t nw, n, ne, w, c, e, sw, s, se;
+
+		multistate_load(multistate, above, i, &nw, &n, &ne);
+		multistate_load(multistate, y, i, &w, &c, &e);
+		multistate_load(multistate, below, i, &sw, &s, &se);
+
+		life_count(nw, n, ne, w, e, sw, s, se, count);
+		excited = (count[0] ^ count[1]) & ~count[2] & ~count[3];
+
+		s0 = le64toh(multistate_row(multistate, multistate->src, 0,
+					    y)[i]);
+		s1 = le64toh(multistate_row(multistate, multistate->src, 1,
+					    y)[i]);
+
+		head = c;
+		tail = ~s0 & s1;
+		conductor = s0 & s1;
+
+		out[0] = conductor | tail;
+		out[1] = head | tail | (conductor & ~excited);
+
+		if (i == multistate->words - 1) {
+			out[0] &= multistate->mask;
+			out[1] &= multistate->mask;
+		}
+
+		multistate_store(multistate, y, i, out);
+	}
+}
+
+static void multistate_tick_band(void *data, unsigned int index,
+				 unsigned int count)
+{
+	struct multistate *multistate = data;
+	unsigned int start, end, y;
+
+	multistate_band(multistate, index, count, &start, &end);
+
+	for (y = start; y < end; y++) {
+		if (multistate->rule.family == MULTISTATE_WIREWORLD)
+			multistate_tick_wireworld(multistate, y);
+		else
+			multistate_tick_generations(multistate, y);
+	}
+}
+
+void multistate_tick(struct multistate *multistate, struct pool *pool,
+		     const void *src, void *dst)
+{
+	multistate->src = src;
+	multistate->dst = dst;
+
+	pool_run(pool, multistate_alive_band, multistate);
+	pool_run(pool, multistate_tick_band, multistate);
+}
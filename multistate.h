@@ -0,0 +1,62 @@
+#ifndef MULTISTATE_H
+#define MULTISTATE_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pool.h"
+#include "rule.h"
+
+#define MULTISTATE_MAX_STATES 256
+
+enum multistate_family {
+	MULTISTATE_GENERATIONS,
+	MULTISTATE_WIREWORLD,
+};
+
+/*
+ * Generations rules such as "/2/3" (Brian's Brain) or "B2/S345/C4" (Star
+ * Wars): state 0 is dead and state 1 alive, cells that die go through the
+ * states 2 to states - 1 before becoming dead and can not be born or
+ * survive meanwhile. WireWorld has the states empty, electron head,
+ * electron tail and conductor.
+ */
+struct multistate_rule {
+	enum multistate_family family;
+	unsigned int states;
+	struct rule rule;
+};
+
+/*
+ * Multi-state universe stored as bit planes, plane p holding bit p of the
+ * state of each cell. Rows of a plane are pitch bytes apart and planes are
+ * stride bytes apart, so plane 0 alone is a universe of the states 0 and
+ * 1 in the same layout as a two-state one.
+ */
+struct multistate {
+	struct multistate_rule rule;
+	unsigned int width;
+	unsigned int height;
+	unsigned int pitch;
+	unsigned int words;
+	unsigned int planes;
+	size_t stride;
+	uint64_t mask;
+
+	/* cells in state 1 of the current generation, packed */
+	uint64_t *alive;
+
+	const void *src;
+	void *dst;
+};
+
+int multistate_parse_rule(struct multistate_rule *rule, const char *string);
+unsigned int multistate_planes(unsigned int states);
+int multistate_create(struct multistate **multistatep,
+		      const struct multistate_rule *rule, unsigned int width,
+		      unsigned int height, unsigned int pitch, size_t stride);
+int multistate_free(struct multistate *multistate);
+void multistate_tick(struct multistate *multistate, struct pool *pool,
+		     const void *src, void *dst);
+
+#endif /* MULTISTATE_H */
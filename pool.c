@@ -0,0 +1,192 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+
+#include "pool.h"
+
+struct pool_worker {
+	struct pool *pool;
+	unsigned int index;
+};
+
+static void *pool_worker(void *arg)
+{
+	struct pool_worker *worker = arg;
+	struct pool *pool = worker->pool;
+	unsigned int index = worker->index;
+	unsigned int generation = 0;
+	void *data;
+	pool_fn fn;
+
+	free(worker);
+
+	while (true) {
+		pthread_mutex_lock(&pool->lock);
+
+		while (pool->generation == generation && !pool->exit)
+			pthread_cond_wait(&pool->start, &pool->lock);
+
+		if (pool->exit) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+
+		generation = pool->generation;
+		data = pool->data;
+		fn = pool->fn;
+
+		pthread_mutex_unlock(&pool->lock);
+
+		fn(data, index, pool->count);
+
+		pthread_mutex_lock(&pool->lock);
+
+		if (--pool->pending == 0)
+			pthread_cond_signal(&pool->done);
+
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return NULL;
+}
+
+/*
+ * Creates a pool of count threads, including the calling thread. Work is
+ * always split into exactly count parts and part i always runs on thread
+ * i, so that data touched by a part stays with the same thread across
+ * runs.
+ */
+int pool_create(struct pool **poolp, unsigned int count)
+{
+	struct pool_worker *worker;
+	struct pool *pool;
+	unsigned int i;
+	int err;
+
+	if (!count)
+		return -EINVAL;
+
+	pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		return -ENOMEM;
+
+	pool->threads = calloc(count, sizeof(pthread_t));
+	if (!pool->threads) {
+		free(pool);
+		return -ENOMEM;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->start, NULL);
+	pthread_cond_init(&pool->done, NULL);
+
+	pool->threads[0] = pthread_self();
+	pool->count = 1;
+
+	for (i = 1; i < count; i++) {
+		worker = malloc(sizeof(*worker));
+		if (!worker) {
+			pool_free(pool);
+			return -ENOMEM;
+		}
+
+		worker->pool = pool;
+		worker->index = i;
+
+		err = pthread_create(&pool->threads[i], NULL, pool_worker,
+				     worker);
+		if (err != 0) {
+			free(worker);
+			pool_free(pool);
+			return -err;
+		}
+
+		pool->count++;
+	}
+
+	*poolp = pool;
+
+	return 0;
+}
+
+int pool_free(struct pool *pool)
+{
+	unsigned int i;
+
+	if (!pool)
+		return -EINVAL;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->exit = true;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 1; i < pool->count; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->start);
+	pthread_mutex_destroy(&pool->lock);
+
+	free(pool->threads);
+	free(pool);
+
+	return 0;
+}
+
+/*
+ * Runs fn on every thread of the pool and returns once all of them have
+ * completed, so the caller can rely on all work being done.
+ */
+void pool_run(struct pool *pool, pool_fn fn, void *data)
+{
+	if (pool->count == 1) {
+		fn(data, 0, 1);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->pending = pool->count - 1;
+	pool->data = data;
+	pool->fn = fn;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	fn(data, 0, pool->count);
+
+	pthread_mutex_lock(&pool->lock);
+
+	while (pool->pending > 0)
+		pthread_cond_wait(&pool->done, &pool->lock);
+
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Pin thread i of the pool to CPU cpus[i % count]. All threads are tried
+ * even if pinning one of them fails, the first error is returned.
+ */
+int pool_set_affinity(struct pool *pool, const unsigned int *cpus,
+		      unsigned int count)
+{
+	unsigned int i;
+	cpu_set_t set;
+	int err, ret = 0;
+
+	if (!pool || !cpus || !count)
+		return -EINVAL;
+
+	for (i = 0; i < pool->count; i++) {
+		CPU_ZERO(&set);
+		CPU_SET(cpus[i % count], &set);
+
+		err = pthread_setaffinity_np(pool->threads[i], sizeof(set),
+					     &set);
+		if (err != 0 && ret == 0)
+			ret = -err;
+	}
+
+	return ret;
+}
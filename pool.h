@@ -0,0 +1,30 @@
+#ifndef POOL_H
+#define POOL_H 1
+
+#include <pthread.h>
+#include <stdbool.h>
+
+typedef void (*pool_fn)(void *data, unsigned int index, unsigned int count);
+
+struct pool {
+	pthread_t *threads;
+	unsigned int count;
+
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	unsigned int generation;
+	unsigned int pending;
+	bool exit;
+
+	pool_fn fn;
+	void *data;
+};
+
+int pool_create(struct pool **poolp, unsigned int count);
+int pool_free(struct pool *pool);
+void pool_run(struct pool *pool, pool_fn fn, void *data);
+int pool_set_affinity(struct pool *pool, const unsigned int *cpus,
+		      unsigned int count);
+
+#endif /* POOL_H */
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "rule.h"
+
+/*
+ * Neighbourhood values of the letters of Hensel notation in the bit order
+ * of Golly's liferules, NE, N, NW, E, SW, S, SE and W in bits 0 to 7, as
+ * the smallest value of each shape (so 3n is 13 and 3j is 14). The cells
+ * rule_parse() sets for a letter have to be exactly the rotations and
+ * reflections of its value.
+ */
+static const struct {
+	unsigned int count;
+	const char *letters;
+	uint8_t neighbours[13];
+} golly_letters[] = {
+	{ 1, "ce", { 1, 2 } },
+	{ 2, "cekain", { 5, 10, 12, 3, 34, 17 } },
+	{ 3, "cekainyqjr", { 21, 42, 26, 11, 7, 13, 28, 19, 14, 35 } },
+	{ 4, "cekainyqjrtwz",
+	  { 85, 170, 30, 15, 54, 23, 29, 27, 46, 43, 39, 57, 51 } },
+};
+
+static const enum rule_input golly_inputs[8] = {
+	RULE_INPUT_NE, RULE_INPUT_N, RULE_INPUT_NW, RULE_INPUT_E,
+	RULE_INPUT_SW, RULE_INPUT_S, RULE_INPUT_SE, RULE_INPUT_W,
+};
+
+static uint8_t golly_to_rule(uint8_t neighbours)
+{
+	uint8_t result = 0;
+	unsigned int i;
+
+	for (i = 0; i < 8; i++)
+		if (neighbours & (1 << i))
+			result |= 1 << golly_inputs[i];
+
+	return result;
+}
+
+static uint8_t rotate(uint8_t neighbours)
+{
+	return neighbours << 2 | neighbours >> 6;
+}
+
+static uint8_t reflect(uint8_t neighbours)
+{
+	uint8_t result = neighbours & 1;
+	unsigned int i;
+
+	for (i = 1; i < 8; i++)
+		if (neighbours & (1 << i))
+			result |= 1 << (8 - i);
+
+	return result;
+}
+
+/* compares the births of "B<count><letter>/S" with the orbit of a shape */
+static int check_letter(unsigned int count, char letter, uint8_t shape)
+{
+	bool orbit[256] = { false };
+	char string[8];
+	struct rule rule;
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < 4; i++) {
+		orbit[shape] = orbit[reflect(shape)] = true;
+		shape = rotate(shape);
+	}
+
+	snprintf(string, sizeof(string), "B%u%c/S", count, letter);
+
+	err = rule_parse(&rule, string);
+	if (err < 0) {
+		fprintf(stderr, "%s: rule_parse() failed: %d\n", string, err);
+		return 1;
+	}
+
+	for (i = 0; i < 256; i++) {
+		if (((rule.table[i / 64] >> (i % 64)) & 1) != orbit[i]) {
+			fprintf(stderr, "%s: neighbourhood %#04x differs\n",
+				string, i);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int main(void)
+{
+	unsigned int i, j, failed = 0;
+	uint8_t shape;
+
+	for (i = 0; i < sizeof(golly_letters) / sizeof(golly_letters[0]); i++) {
+		unsigned int count = golly_letters[i].count;
+
+		for (j = 0; golly_letters[i].letters[j]; j++) {
+			char letter = golly_letters[i].letters[j];
+
+			shape = golly_to_rule(golly_letters[i].neighbours[j]);
+			failed += check_letter(count, letter, shape);
+
+			/* letters for five to seven are the complements */
+			if (count < 4)
+				failed += check_letter(8 - count, letter,
+						       (uint8_t)~shape);
+		}
+	}
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
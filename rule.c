@@ -0,0 +1,364 @@
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+
+#include "rule.h"
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#define N  (1 << RULE_INPUT_N)
+#define NE (1 << RULE_INPUT_NE)
+#define E  (1 << RULE_INPUT_E)
+#define SE (1 << RULE_INPUT_SE)
+#define S  (1 << RULE_INPUT_S)
+#define SW (1 << RULE_INPUT_SW)
+#define W  (1 << RULE_INPUT_W)
+#define NW (1 << RULE_INPUT_NW)
+
+static const unsigned int rule_neighbours[] = {
+	[RULE_MOORE] = 8,
+	[RULE_HEXAGONAL] = 6,
+	[RULE_VON_NEUMANN] = 4,
+};
+
+/*
+ * One representative of each of the letters of Hensel notation for up to
+ * four neighbours. The others are obtained by rotating and reflecting it,
+ * letters for five to seven neighbours are the complements of those for
+ * three to one neighbours.
+ */
+static const struct {
+	unsigned int count;
+	char letter;
+	uint8_t neighbours;
+} rule_letters[] = {
+	{ 1, 'c', NE },
+	{ 1, 'e', N },
+	{ 2, 'c', NE | SE },
+	{ 2, 'e', N | E },
+	{ 2, 'k', N | SE },
+	{ 2, 'a', N | NE },
+	{ 2, 'i', N | S },
+	{ 2, 'n', NE | SW },
+	{ 3, 'c', NE | SE | SW },
+	{ 3, 'e', N | E | W },
+	{ 3, 'k', N | E | SW },
+	{ 3, 'a', N | W | NW },
+	{ 3, 'i', N | NE | NW },
+	{ 3, 'n', N | NE | SE },
+	{ 3, 'y', N | SE | SW },
+	{ 3, 'q', N | SE | NW },
+	{ 3, 'j', N | E | SE },
+	{ 3, 'r', N | SE | S },
+	{ 4, 'c', NE | SE | SW | NW },
+	{ 4, 'e', N | E | S | W },
+	{ 4, 'k', N | E | SE | SW },
+	{ 4, 'a', N | SW | W | NW },
+	{ 4, 'i', N | NE | SE | S },
+	{ 4, 'n', N | NE | SE | NW },
+	{ 4, 'y', N | SE | SW | NW },
+	{ 4, 'q', N | NE | E | SW },
+	{ 4, 'j', N | E | S | SW },
+	{ 4, 'r', N | E | W | NW },
+	{ 4, 't', N | NE | S | NW },
+	{ 4, 'w', N | NE | SW | W },
+	{ 4, 'z', N | NE | S | SW },
+};
+
+static inline uint8_t rule_rotate(uint8_t neighbours)
+{
+	return neighbours << 2 | neighbours >> 6;
+}
+
+/* mirror along the north-south axis */
+static inline uint8_t rule_reflect(uint8_t neighbours)
+{
+	uint8_t result = neighbours & N;
+	unsigned int i;
+
+	for (i = 1; i < 8; i++)
+		if (neighbours & (1 << i))
+			result |= 1 << (8 - i);
+
+	return result;
+}
+
+static inline void rule_set(uint64_t *table, unsigned int index)
+{
+	table[index / 64] |= 1ull << (index % 64);
+}
+
+static inline bool rule_get(const struct rule *rule, unsigned int index)
+{
+	return (rule->table[index / 64] >> (index % 64)) & 1;
+}
+
+/* sets all rotations and reflections of a neighbourhood */
+static void rule_set_letter(uint64_t *table, unsigned int cell,
+			    unsigned int count, char letter)
+{
+	unsigned int complement = count > 4, i, j;
+	uint8_t neighbours;
+
+	if (complement)
+		count = 8 - count;
+
+	for (i = 0; i < ARRAY_SIZE(rule_letters); i++) {
+		if (rule_letters[i].count != count ||
+		    rule_letters[i].letter != letter)
+			continue;
+
+		neighbours = rule_letters[i].neighbours;
+		if (complement)
+			neighbours = ~neighbours;
+
+		for (j = 0; j < 8; j++) {
+			rule_set(table, cell << 8 | neighbours);
+			rule_set(table, cell << 8 | rule_reflect(neighbours));
+			neighbours = rule_rotate(neighbours);
+		}
+	}
+}
+
+static bool rule_has_letter(unsigned int count, char letter)
+{
+	unsigned int i;
+
+	if (count > 4)
+		count = 8 - count;
+
+	for (i = 0; i < ARRAY_SIZE(rule_letters); i++)
+		if (rule_letters[i].count == count &&
+		    rule_letters[i].letter == letter)
+			return true;
+
+	return false;
+}
+
+/*
+ * Parses a list of neighbour counts such as "23" into a bit mask and sets
+ * the corresponding entries of the table for the given state of the cell.
+ * Each count may be followed by Hensel letters, e.g. "2ak3", which limit
+ * it to the listed shapes, or by a minus and letters, e.g. "2-a", which
+ * exclude them.
+ */
+static const char *rule_parse_counts(struct rule *rule, const char *ptr,
+				     unsigned int cell, uint16_t *mask)
+{
+	const char *letters;
+	unsigned int count, i;
+	bool negate;
+
+	*mask = 0;
+
+	while (isdigit(*ptr)) {
+		count = *ptr++ - '0';
+		if (count > 8)
+			return NULL;
+
+		negate = *ptr == '-';
+		if (negate)
+			ptr++;
+
+		for (letters = ptr; *ptr && strchr("ceaiknjqrytwz", *ptr); ptr++)
+			if (!rule_has_letter(count, *ptr))
+				return NULL;
+
+		if (negate && ptr == letters)
+			return NULL;
+
+		if (ptr > letters)
+			rule->isotropic = true;
+
+		*mask |= 1 << count;
+
+		if (ptr == letters || negate) {
+			for (i = 0; i < 256; i++)
+				if (__builtin_popcount(i) == count)
+					rule_set(rule->table, cell << 8 | i);
+		}
+
+		while (letters < ptr) {
+			uint64_t shapes[8] = { 0 };
+
+			rule_set_letter(shapes, cell, count, *letters++);
+
+			for (i = 0; i < 8; i++) {
+				if (negate)
+					rule->table[i] &= ~shapes[i];
+				else
+					rule->table[i] |= shapes[i];
+			}
+		}
+	}
+
+	return ptr;
+}
+
+#define RULE_DONT_CARE INT_MAX
+
+/* returns an existing node with the same inputs or adds a new one */
+static int rule_node(struct rule *rule, unsigned int input, int low, int high)
+{
+	unsigned int i;
+
+	if (low < 0 || high < 0)
+		return low < 0 ? low : high;
+
+	if (low == RULE_DONT_CARE)
+		return high;
+
+	if (high == RULE_DONT_CARE || low == high)
+		return low;
+
+	for (i = 2; i < rule->count; i++)
+		if (rule->nodes[i].input == input && rule->nodes[i].low == low &&
+		    rule->nodes[i].high == high)
+			return i;
+
+	if (rule->count == RULE_MAX_NODES)
+		return -ENOSPC;
+
+	rule->nodes[i].input = input;
+	rule->nodes[i].low = low;
+	rule->nodes[i].high = high;
+
+	return rule->count++;
+}
+
+/*
+ * Builds the part of the circuit for the neighbourhoods that match index
+ * below bit and have ones live neighbours from bit on. The neighbour count
+ * is already known here, so only neighbourhoods with that count need to
+ * be told apart, and the part is a constant as soon as they all lead to
+ * the same state.
+ */
+static int rule_build_neighbours(struct rule *rule, unsigned int index,
+				 unsigned int bit, unsigned int ones)
+{
+	bool seen[2] = { false, false };
+	unsigned int rest;
+	int low, high;
+
+	for (rest = 0; rest < 1u << (8 - bit); rest++)
+		if (__builtin_popcount(rest) == ones)
+			seen[rule_get(rule, index | rest << bit)] = true;
+
+	if (!seen[0] && !seen[1])
+		return RULE_DONT_CARE;
+
+	if (!seen[0] || !seen[1])
+		return seen[1];
+
+	low = rule_build_neighbours(rule, index, bit + 1, ones);
+	high = rule_build_neighbours(rule, index | 1 << bit, bit + 1, ones - 1);
+
+	return rule_node(rule, RULE_INPUT_N + bit, low, high);
+}
+
+/* branches on the bits of the neighbour count, most significant first */
+static int rule_build_count(struct rule *rule, unsigned int cell,
+			    unsigned int count, int bit)
+{
+	int low, high;
+
+	if (bit < 0) {
+		if (count > 8)
+			return RULE_DONT_CARE;
+
+		return rule_build_neighbours(rule, cell << 8, 0, count);
+	}
+
+	low = rule_build_count(rule, cell, count, bit - 1);
+	high = rule_build_count(rule, cell, count | 1 << bit, bit - 1);
+
+	return rule_node(rule, RULE_INPUT_COUNT + bit, low, high);
+}
+
+static int rule_compile(struct rule *rule)
+{
+	int low, high, root;
+
+	rule->count = 2;
+
+	low = rule_build_count(rule, 0, 0, 3);
+	high = rule_build_count(rule, 1, 0, 3);
+
+	root = rule_node(rule, RULE_INPUT_CELL, low, high);
+	if (root < 0)
+		return root;
+
+	rule->root = root == RULE_DONT_CARE ? 0 : root;
+
+	return 0;
+}
+
+/*
+ * Parses rules in B/S notation such as "B36/S23", or in S/B notation such
+ * as "23/36". A suffix of H or V selects the hexagonal or von Neumann
+ * neighbourhood, e.g. "B2/S34H". Rules on the Moore neighbourhood may use
+ * Hensel notation, e.g. "B2-a/S12".
+ */
+int rule_parse(struct rule *rule, const char *string)
+{
+	const char *ptr = string;
+	uint16_t first, second;
+	bool bs = false;
+
+	memset(rule, 0, sizeof(*rule));
+
+	if (toupper(*ptr) == 'B') {
+		bs = true;
+		ptr++;
+	}
+
+	ptr = rule_parse_counts(rule, ptr, !bs, &first);
+	if (!ptr || *ptr++ != '/')
+		return -EINVAL;
+
+	if (bs) {
+		if (toupper(*ptr++) != 'S')
+			return -EINVAL;
+	}
+
+	ptr = rule_parse_counts(rule, ptr, bs, &second);
+	if (!ptr)
+		return -EINVAL;
+
+	switch (toupper(*ptr)) {
+	case 'H':
+		rule->neighbourhood = RULE_HEXAGONAL;
+		ptr++;
+		break;
+
+	case 'V':
+		rule->neighbourhood = RULE_VON_NEUMANN;
+		ptr++;
+		break;
+	}
+
+	if (*ptr)
+		return -EINVAL;
+
+	rule->birth = bs ? first : second;
+	rule->survive = bs ? second : first;
+
+	/* counts beyond the size of the neighbourhood can never occur */
+	if ((rule->birth | rule->survive) >>
+	    (rule_neighbours[rule->neighbourhood] + 1))
+		return -EINVAL;
+
+	/* Hensel letters only describe the Moore neighbourhood */
+	if (rule->isotropic && rule->neighbourhood != RULE_MOORE)
+		return -EINVAL;
+
+	return rule_compile(rule);
+}
+
+bool rule_is_life(const struct rule *rule)
+{
+	return rule->neighbourhood == RULE_MOORE && !rule->isotropic &&
+	       rule->birth == (1 << 3) &&
+	       rule->survive == ((1 << 2) | (1 << 3));
+}
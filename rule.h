@@ -0,0 +1,142 @@
+#ifndef RULE_H
+#define RULE_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "life.h"
+
+enum rule_neighbourhood {
+	RULE_MOORE,
+	RULE_HEXAGONAL,
+	RULE_VON_NEUMANN,
+};
+
+/*
+ * Inputs of the circuit of a rule: the eight neighbours, the cell itself
+ * and the four bit planes of the neighbour count.
+ */
+enum rule_input {
+	RULE_INPUT_N,
+	RULE_INPUT_NE,
+	RULE_INPUT_E,
+	RULE_INPUT_SE,
+	RULE_INPUT_S,
+	RULE_INPUT_SW,
+	RULE_INPUT_W,
+	RULE_INPUT_NW,
+	RULE_INPUT_CELL,
+	RULE_INPUT_COUNT,
+	RULE_NUM_INPUTS = RULE_INPUT_COUNT + 4,
+};
+
+#define RULE_MAX_NODES 512
+
+/* number of words the circuit is evaluated for at a time */
+#define RULE_WORDS 8
+
+/* selects high where the input is set and low elsewhere */
+struct rule_node {
+	uint8_t input;
+	uint16_t low;
+	uint16_t high;
+};
+
+/*
+ * Rule on one of the neighbourhoods, with bit n of birth and survive set
+ * if a cell is born or survives with n live neighbours in some shape.
+ * Hexagonal universes are stored skewed, as in RLE files: the neighbours
+ * of a cell are those of the Moore neighbourhood except NE and SW.
+ *
+ * The transition table is indexed by the cell in bit 8 and its neighbours
+ * N, NE, ..., NW in bits 0 to 7. It is compiled into a circuit of
+ * multiplexers that branches on the cell and the neighbour count first,
+ * so that only the counts at which the shape of the neighbourhood matters
+ * (in isotropic non-totalistic rules) look at individual neighbours. Nodes
+ * 0 and 1 are the constants, every other node only refers to nodes before
+ * it.
+ */
+struct rule {
+	uint16_t birth;
+	uint16_t survive;
+	enum rule_neighbourhood neighbourhood;
+	bool isotropic;
+
+	uint64_t table[8];
+	unsigned int count;
+	unsigned int root;
+	struct rule_node nodes[RULE_MAX_NODES];
+};
+
+int rule_parse(struct rule *rule, const char *string);
+bool rule_is_life(const struct rule *rule);
+
+/* sets up the inputs of the circuit for word j of a batch */
+static inline void rule_load(const struct rule *rule,
+			     uint64_t inputs[][RULE_WORDS], unsigned int j,
+			     uint64_t nw, uint64_t n, uint64_t ne,
+			     uint64_t w, uint64_t c, uint64_t e,
+			     uint64_t sw, uint64_t s, uint64_t se)
+{
+	uint64_t count[4];
+	unsigned int i;
+
+	switch (rule->neighbourhood) {
+	case RULE_HEXAGONAL:
+		life_count(nw, n, 0, w, e, 0, s, se, count);
+		break;
+
+	case RULE_VON_NEUMANN:
+		life_count(0, n, 0, w, e, 0, s, 0, count);
+		break;
+
+	default:
+		life_count(nw, n, ne, w, e, sw, s, se, count);
+		break;
+	}
+
+	inputs[RULE_INPUT_N][j] = n;
+	inputs[RULE_INPUT_NE][j] = ne;
+	inputs[RULE_INPUT_E][j] = e;
+	inputs[RULE_INPUT_SE][j] = se;
+	inputs[RULE_INPUT_S][j] = s;
+	inputs[RULE_INPUT_SW][j] = sw;
+	inputs[RULE_INPUT_W][j] = w;
+	inputs[RULE_INPUT_NW][j] = nw;
+	inputs[RULE_INPUT_CELL][j] = c;
+
+	for (i = 0; i < 4; i++)
+		inputs[RULE_INPUT_COUNT + i][j] = count[i];
+}
+
+/*
+ * Evaluates the circuit for a batch of words. Each step depends on the
+ * results of earlier ones, so working on several independent words at a
+ * time keeps the latency of the steps from adding up.
+ */
+static inline void rule_eval(const struct rule *rule,
+			     uint64_t inputs[][RULE_WORDS], uint64_t *next)
+{
+	uint64_t values[RULE_MAX_NODES][RULE_WORDS];
+	unsigned int i, j;
+
+	for (j = 0; j < RULE_WORDS; j++) {
+		values[0][j] = 0;
+		values[1][j] = ~0ull;
+	}
+
+	for (i = 2; i < rule->count; i++) {
+		const struct rule_node *node = &rule->nodes[i];
+		const uint64_t *low = values[node->low];
+		const uint64_t *high = values[node->high];
+		const uint64_t *input = inputs[node->input];
+
+		for (j = 0; j < RULE_WORDS; j++)
+			values[i][j] = low[j] ^ (input[j] & (low[j] ^ high[j]));
+	}
+
+	for (j = 0; j < RULE_WORDS; j++)
+		next[j] = values[rule->root][j];
+}
+
+#endif /* RULE_H */
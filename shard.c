@@ -0,0 +1,209 @@
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "shard.h"
+
+/* how often a waiting presenter checks whether the workers are alive */
+#define SHARD_POLL_NS (100 * 1000 * 1000)
+
+static long futex(uint32_t *addr, int op, uint32_t value,
+		  const struct timespec *timeout)
+{
+	return syscall(SYS_futex, addr, op, value, timeout, NULL, 0);
+}
+
+/*
+ * The segment is a shared anonymous mapping, so it is inherited by the
+ * worker processes forked from the creator. The data area is 64-byte
+ * aligned.
+ */
+int shards_create(struct shards **shardsp, unsigned int count, size_t size)
+{
+	struct shards *shards;
+	void *ptr;
+
+	if (!count)
+		return -EINVAL;
+
+	shards = calloc(1, sizeof(*shards));
+	if (!shards)
+		return -ENOMEM;
+
+	shards->pids = calloc(count, sizeof(pid_t));
+	if (!shards->pids) {
+		free(shards);
+		return -ENOMEM;
+	}
+
+	shards->size = 64 + size;
+
+	ptr = mmap(NULL, shards->size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED) {
+		free(shards->pids);
+		free(shards);
+		return -errno;
+	}
+
+	shards->header = ptr;
+	shards->data = ptr + 64;
+	shards->count = count;
+	shards->presenter = getpid();
+
+	*shardsp = shards;
+
+	return 0;
+}
+
+/* Terminates and reaps any workers that are still running. */
+int shards_free(struct shards *shards)
+{
+	unsigned int i;
+
+	if (!shards)
+		return -EINVAL;
+
+	for (i = 0; i < shards->count; i++) {
+		if (shards->pids[i] > 0) {
+			kill(shards->pids[i], SIGKILL);
+			waitpid(shards->pids[i], NULL, 0);
+		}
+	}
+
+	munmap(shards->header, shards->size);
+	free(shards->pids);
+	free(shards);
+
+	return 0;
+}
+
+/*
+ * Fork one worker per shard. Workers die with the presenter and ignore
+ * SIGINT, which the presenter handles for the whole group.
+ */
+int shards_spawn(struct shards *shards, shard_fn fn, void *data)
+{
+	unsigned int i;
+	pid_t pid;
+	int err;
+
+	for (i = 0; i < shards->count; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err = -errno;
+			shards_abort(shards);
+			return err;
+		}
+
+		if (pid == 0) {
+			prctl(PR_SET_PDEATHSIG, SIGKILL);
+			signal(SIGINT, SIG_IGN);
+
+			if (getppid() != shards->presenter)
+				_exit(1);
+
+			_exit(fn(shards, i, data) < 0 ? 1 : 0);
+		}
+
+		shards->pids[i] = pid;
+	}
+
+	return 0;
+}
+
+/*
+ * Returns true if a worker has exited. Workers only exit after being told
+ * to, so any exit before that counts as a crash.
+ */
+static bool shards_check(struct shards *shards)
+{
+	unsigned int i;
+	int status;
+
+	for (i = 0; i < shards->count; i++) {
+		if (shards->pids[i] <= 0)
+			continue;
+
+		if (waitpid(shards->pids[i], &status, WNOHANG) ==
+		    shards->pids[i]) {
+			if (WIFSIGNALED(status))
+				fprintf(stderr, "shard %u killed by signal "
+					"%d\n", i, WTERMSIG(status));
+			else
+				fprintf(stderr, "shard %u exited with status "
+					"%d\n", i, WEXITSTATUS(status));
+
+			shards->pids[i] = 0;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void shards_abort(struct shards *shards)
+{
+	struct shard_barrier *barrier = &shards->header->barrier;
+
+	__atomic_store_n(&shards->header->abort, 1, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&barrier->phase, 1, __ATOMIC_RELEASE);
+	futex(&barrier->phase, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+/*
+ * Wait until all workers and the presenter (the process that created the
+ * shards) have reached the barrier. The futex is process-shared since the
+ * workers are separate processes. While waiting, the presenter polls for
+ * crashed workers and aborts the run if one is found, which releases
+ * everybody else with -ECANCELED.
+ */
+int shards_barrier(struct shards *shards)
+{
+	struct shard_barrier *barrier = &shards->header->barrier;
+	struct timespec timeout = { 0, SHARD_POLL_NS };
+	bool presenter = getpid() == shards->presenter;
+	uint32_t phase;
+
+	phase = __atomic_load_n(&barrier->phase, __ATOMIC_ACQUIRE);
+
+	if (__atomic_load_n(&shards->header->abort, __ATOMIC_ACQUIRE))
+		return -ECANCELED;
+
+	if (__atomic_add_fetch(&barrier->count, 1, __ATOMIC_ACQ_REL) ==
+	    shards->count + 1) {
+		__atomic_store_n(&barrier->count, 0, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&barrier->phase, 1, __ATOMIC_RELEASE);
+		futex(&barrier->phase, FUTEX_WAKE, INT_MAX, NULL);
+	} else {
+		while (__atomic_load_n(&barrier->phase, __ATOMIC_ACQUIRE) ==
+		       phase) {
+			futex(&barrier->phase, FUTEX_WAIT, phase,
+			      presenter ? &timeout : NULL);
+
+			if (__atomic_load_n(&barrier->phase, __ATOMIC_ACQUIRE) !=
+			    phase)
+				break;
+
+			if (presenter && shards_check(shards)) {
+				shards_abort(shards);
+				break;
+			}
+		}
+	}
+
+	if (__atomic_load_n(&shards->header->abort, __ATOMIC_ACQUIRE))
+		return -ECANCELED;
+
+	return 0;
+}
@@ -0,0 +1,43 @@
+#ifndef SHARD_H
+#define SHARD_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+struct shard_barrier {
+	uint32_t count;
+	uint32_t phase;
+};
+
+/* lives at the start of the shared memory segment */
+struct shard_header {
+	struct shard_barrier barrier;
+	uint32_t abort;
+	uint32_t done;
+	uint32_t current;
+};
+
+struct shards;
+
+typedef int (*shard_fn)(struct shards *shards, unsigned int index,
+			void *data);
+
+struct shards {
+	struct shard_header *header;
+	void *data;
+	size_t size;
+
+	unsigned int count;
+	pid_t presenter;
+	pid_t *pids;
+};
+
+int shards_create(struct shards **shardsp, unsigned int count, size_t size);
+int shards_free(struct shards *shards);
+int shards_spawn(struct shards *shards, shard_fn fn, void *data);
+int shards_barrier(struct shards *shards);
+void shards_abort(struct shards *shards);
+
+#endif /* SHARD_H */
@@ -0,0 +1,246 @@
+#include <endian.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "life.h"
+#include "tile.h"
+
+struct tile_key {
+	uint64_t code;
+	uint32_t index;
+};
+
+static uint64_t morton_code(uint32_t x, uint32_t y)
+{
+	uint64_t code = 0;
+	unsigned int i;
+
+	for (i = 0; i < 32; i++) {
+		code |= (uint64_t)((x >> i) & 1) << (2 * i);
+		code |= (uint64_t)((y >> i) & 1) << (2 * i + 1);
+	}
+
+	return code;
+}
+
+static int tile_key_compare(const void *a, const void *b)
+{
+	const struct tile_key *ka = a, *kb = b;
+
+	return (ka->code > kb->code) - (ka->code < kb->code);
+}
+
+/*
+ * Build the table mapping tile coordinates to storage slots. For Morton
+ * order the tiles are sorted by their Z-order code and packed, so grids
+ * that are not square or not a power of two in size waste no memory.
+ */
+static int tiles_build_index(struct tiles *tiles)
+{
+	unsigned int count = tiles->columns * tiles->rows, tx, ty, i;
+	struct tile_key *keys;
+
+	if (tiles->order == TILE_ORDER_ROWS) {
+		for (i = 0; i < count; i++)
+			tiles->index[i] = i;
+
+		return 0;
+	}
+
+	keys = calloc(count, sizeof(*keys));
+	if (!keys)
+		return -ENOMEM;
+
+	for (ty = 0; ty < tiles->rows; ty++) {
+		for (tx = 0; tx < tiles->columns; tx++) {
+			i = ty * tiles->columns + tx;
+			keys[i].code = morton_code(tx, ty);
+			keys[i].index = i;
+		}
+	}
+
+	qsort(keys, count, sizeof(*keys), tile_key_compare);
+
+	for (i = 0; i < count; i++)
+		tiles->index[keys[i].index] = i;
+
+	free(keys);
+
+	return 0;
+}
+
+int tiles_create(struct tiles **tilesp, unsigned int width,
+		 unsigned int height, enum tile_order order)
+{
+	struct tiles *tiles;
+	size_t size;
+	int err;
+
+	if (!width || !height || width % TILE_SIZE || height % TILE_SIZE)
+		return -EINVAL;
+
+	tiles = calloc(1, sizeof(*tiles));
+	if (!tiles)
+		return -ENOMEM;
+
+	tiles->width = width;
+	tiles->height = height;
+	tiles->columns = width / TILE_SIZE;
+	tiles->rows = height / TILE_SIZE;
+	tiles->order = order;
+
+	size = (size_t)tiles->columns * tiles->rows * TILE_SIZE *
+	       sizeof(uint64_t);
+
+	tiles->index = calloc(tiles->columns * tiles->rows,
+			      sizeof(*tiles->index));
+	tiles->parents = aligned_alloc(64, size);
+	tiles->cells = aligned_alloc(64, size);
+
+	if (!tiles->index || !tiles->parents || !tiles->cells) {
+		tiles_free(tiles);
+		return -ENOMEM;
+	}
+
+	memset(tiles->parents, 0, size);
+	memset(tiles->cells, 0, size);
+
+	err = tiles_build_index(tiles);
+	if (err < 0) {
+		tiles_free(tiles);
+		return err;
+	}
+
+	*tilesp = tiles;
+
+	return 0;
+}
+
+int tiles_free(struct tiles *tiles)
+{
+	if (!tiles)
+		return -EINVAL;
+
+	free(tiles->cells);
+	free(tiles->parents);
+	free(tiles->index);
+	free(tiles);
+
+	return 0;
+}
+
+/*
+ * Convert a linear bitmap, with bit x % 8 of byte x / 8 of each row holding
+ * cell x, to and from the current generation. Rows of the linear bitmap
+ * must be 64-bit aligned.
+ */
+void tiles_from_linear(struct tiles *tiles, const void *src,
+		       unsigned int pitch)
+{
+	unsigned int tx, y;
+
+	for (y = 0; y < tiles->height; y++) {
+		const uint64_t *row = src + y * pitch;
+
+		for (tx = 0; tx < tiles->columns; tx++)
+			tiles_tile(tiles, tiles->parents, tx,
+				   y / TILE_SIZE)[y % TILE_SIZE] =
+				le64toh(row[tx]);
+	}
+}
+
+void tiles_to_linear(struct tiles *tiles, void *dst, unsigned int pitch)
+{
+	unsigned int tx, y;
+
+	for (y = 0; y < tiles->height; y++) {
+		uint64_t *row = dst + y * pitch;
+
+		for (tx = 0; tx < tiles->columns; tx++)
+			row[tx] = htole64(tiles_tile(tiles, tiles->parents, tx,
+						     y / TILE_SIZE)[y % TILE_SIZE]);
+	}
+}
+
+static inline void tile_load(uint64_t west, uint64_t center, uint64_t east,
+			     uint64_t *w, uint64_t *c, uint64_t *e)
+{
+	*w = (center << 1) | (west >> 63);
+	*c = center;
+	*e = (center >> 1) | (east << 63);
+}
+
+/*
+ * Compute the next generation of a single tile. All rows but the first and
+ * last come from the tile itself and its left and right neighbours, the
+ * remaining two from the tiles above and below.
+ */
+static void tiles_tick_tile(struct tiles *tiles, unsigned int tx,
+			    unsigned int ty)
+{
+	unsigned int left = (tx + tiles->columns - 1) % tiles->columns;
+	unsigned int right = (tx + 1) % tiles->columns;
+	unsigned int up = (ty + tiles->rows - 1) % tiles->rows;
+	unsigned int down = (ty + 1) % tiles->rows;
+	const uint64_t *tile[3][3];
+	uint64_t *out;
+	unsigned int i;
+
+	tile[0][0] = tiles_tile(tiles, tiles->parents, left, up);
+	tile[0][1] = tiles_tile(tiles, tiles->parents, tx, up);
+	tile[0][2] = tiles_tile(tiles, tiles->parents, right, up);
+	tile[1][0] = tiles_tile(tiles, tiles->parents, left, ty);
+	tile[1][1] = tiles_tile(tiles, tiles->parents, tx, ty);
+	tile[1][2] = tiles_tile(tiles, tiles->parents, right, ty);
+	tile[2][0] = tiles_tile(tiles, tiles->parents, left, down);
+	tile[2][1] = tiles_tile(tiles, tiles->parents, tx, down);
+	tile[2][2] = tiles_tile(tiles, tiles->parents, right, down);
+
+	out = tiles_tile(tiles, tiles->cells, tx, ty);
+
+	for (i = 0; i < TILE_SIZE; i++) {
+		uint64_t nw, n, ne, w, c, e, sw, s, se;
+		unsigned int a = (i + TILE_SIZE - 1) % TILE_SIZE;
+		unsigned int b = (i + 1) % TILE_SIZE;
+		unsigned int ra = i > 0 ? 1 : 0;
+		unsigned int rb = i < TILE_SIZE - 1 ? 1 : 2;
+
+		tile_load(tile[ra][0][a], tile[ra][1][a], tile[ra][2][a],
+			  &nw, &n, &ne);
+		tile_load(tile[1][0][i], tile[1][1][i], tile[1][2][i],
+			  &w, &c, &e);
+		tile_load(tile[rb][0][b], tile[rb][1][b], tile[rb][2][b],
+			  &sw, &s, &se);
+
+		out[i] = life_next(nw, n, ne, w, c, e, sw, s, se);
+	}
+}
+
+static void tiles_tick_band(void *data, unsigned int index,
+			    unsigned int count)
+{
+	struct tiles *tiles = data;
+	unsigned int rows = (tiles->rows + count - 1) / count;
+	unsigned int start = index * rows, end = start + rows, tx, ty;
+
+	if (end > tiles->rows)
+		end = tiles->rows;
+
+	for (ty = start; ty < end; ty++)
+		for (tx = 0; tx < tiles->columns; tx++)
+			tiles_tick_tile(tiles, tx, ty);
+}
+
+void tiles_tick(struct tiles *tiles, struct pool *pool)
+{
+	pool_run(pool, tiles_tick_band, tiles);
+}
+
+void tiles_swap(struct tiles *tiles)
+{
+	uint64_t *tmp = tiles->parents;
+
+	tiles->parents = tiles->cells;
+	tiles->cells = tmp;
+}
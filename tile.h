@@ -0,0 +1,69 @@
+#ifndef TILE_H
+#define TILE_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pool.h"
+
+#define TILE_SIZE 64
+
+enum tile_order {
+	TILE_ORDER_ROWS,
+	TILE_ORDER_MORTON,
+};
+
+/*
+ * Cells stored in tiles of 64x64 cells, each tile being 64 consecutive
+ * words with one word per row. Tiles are laid out either row by row or
+ * along a Morton (Z-order) curve, in both cases neighbouring rows of a tile
+ * are adjacent in memory.
+ */
+struct tiles {
+	unsigned int width;
+	unsigned int height;
+	unsigned int columns;
+	unsigned int rows;
+	enum tile_order order;
+
+	uint32_t *index;
+	uint64_t *parents;
+	uint64_t *cells;
+};
+
+int tiles_create(struct tiles **tilesp, unsigned int width,
+		 unsigned int height, enum tile_order order);
+int tiles_free(struct tiles *tiles);
+
+static inline uint64_t *tiles_tile(struct tiles *tiles, uint64_t *base,
+				   unsigned int tx, unsigned int ty)
+{
+	return base + tiles->index[ty * tiles->columns + tx] * TILE_SIZE;
+}
+
+static inline uint64_t *tiles_word(struct tiles *tiles, uint64_t *base,
+				   unsigned int x, unsigned int y)
+{
+	return tiles_tile(tiles, base, x / TILE_SIZE, y / TILE_SIZE) +
+	       y % TILE_SIZE;
+}
+
+static inline bool tiles_get(struct tiles *tiles, unsigned int x,
+			     unsigned int y)
+{
+	return (*tiles_word(tiles, tiles->parents, x, y) >> (x % TILE_SIZE)) & 1;
+}
+
+static inline void tiles_set(struct tiles *tiles, unsigned int x,
+			     unsigned int y)
+{
+	*tiles_word(tiles, tiles->parents, x, y) |= 1ull << (x % TILE_SIZE);
+}
+
+void tiles_from_linear(struct tiles *tiles, const void *src,
+		       unsigned int pitch);
+void tiles_to_linear(struct tiles *tiles, void *dst, unsigned int pitch);
+void tiles_tick(struct tiles *tiles, struct pool *pool);
+void tiles_swap(struct tiles *tiles);
+
+#endif /* TILE_H */